@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Helpers shared by the benchmark executables. Results are printed in the Google Benchmark
+// console format so that runs can be compared with the usual tooling.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Benchmark {
+
+using Clock = std::chrono::steady_clock;
+
+inline double nanosecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+inline void printHeader()
+{
+    std::printf("%-48s %14s %12s %s\n", "Benchmark", "Time", "Iterations", "UserCounters...");
+    std::printf("%s\n", std::string(100, '-').c_str());
+}
+
+// Collects per-operation latencies and reports them with their percentiles
+class Latencies {
+public:
+    explicit Latencies(size_t expected = 0) { m_samples.reserve(expected); }
+
+    void add(double nanoseconds) { m_samples.push_back(nanoseconds); }
+    size_t size() const { return m_samples.size(); }
+
+    double percentile(double p)
+    {
+        if (m_samples.empty())
+            return 0;
+        if (!m_sorted) {
+            std::sort(m_samples.begin(), m_samples.end());
+            m_sorted = true;
+        }
+        size_t index = std::min(m_samples.size() - 1, size_t(p / 100. * m_samples.size()));
+        return m_samples[index];
+    }
+
+    void print(const std::string& name)
+    {
+        double sum = 0;
+        for (double sample : m_samples)
+            sum += sample;
+        double mean = m_samples.empty() ? 0 : sum / m_samples.size();
+
+        std::printf("%-48s %11.0f ns %12zu p50=%.0fns p90=%.0fns p99=%.0fns p99.9=%.0fns max=%.0fns\n",
+            name.c_str(), mean, m_samples.size(), percentile(50), percentile(90), percentile(99), percentile(99.9), percentile(100));
+    }
+
+private:
+    std::vector<double> m_samples;
+    bool m_sorted { false };
+};
+
+inline void printThroughput(const std::string& name, uint64_t operations, double nanoseconds, const char* unit = "items")
+{
+    std::printf("%-48s %11.0f ns %12llu %s_per_second=%.3fk/s\n", name.c_str(), nanoseconds / operations,
+        static_cast<unsigned long long>(operations), unit, operations / (nanoseconds / 1e9) / 1000.);
+}
+
+} // namespace Benchmark
@@ -0,0 +1,208 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Compares the event loops IPC endpoints can wait on (see src/event-source.h) by how fast an
+// idle IPC::Host thread wakes up to handle a message. The client on the main thread pauses
+// before each message so that the host thread is asleep when it arrives, then waits for the
+// reply. Reports the wakeup latency, measured from the send to the handler running, the round
+// trip, and how many times the host thread was switched out per message.
+// ALooper is only available on Android and is not part of the comparison.
+//
+// Usage: bench-event-wakeup [iterations]
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "ipc.h"
+
+namespace {
+
+// Message codes private to the benchmark, away from the ones in ipc-messages.h
+enum MessageCode : uint64_t {
+    Ping = 1000,
+    Quit,
+};
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Benchmark::Clock::now().time_since_epoch()).count();
+}
+
+long contextSwitches()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+class HostThread final : public IPC::Host::Handler {
+public:
+    HostThread(IPC::EventSource::Loop loop, uint64_t iterations)
+        : m_loop(loop)
+        , m_latencies(iterations)
+        , m_thread([this] { run(); })
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_clientFd != -1; });
+    }
+
+    ~HostThread()
+    {
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    int clientFd() const { return m_clientFd; }
+
+    // Once the client has sent Quit, results can be read after joining
+    void join() { m_thread.join(); }
+    Benchmark::Latencies& latencies() { return m_latencies; }
+    long contextSwitches() const { return m_contextSwitches; }
+
+private:
+    void run()
+    {
+        GMainContext* context = g_main_context_new();
+        g_main_context_push_thread_default(context);
+        GMainLoop* loop = g_main_loop_new(context, FALSE);
+        m_glibLoop = loop;
+
+        IPC::EventSource::setThreadLoop(m_loop);
+        m_host.initialize(*this);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_clientFd = m_host.releaseClientFD(true);
+        }
+        m_condition.notify_one();
+
+        long switches = ::contextSwitches();
+        if (m_loop == IPC::EventSource::Loop::Epoll) {
+            struct pollfd pollFd = { IPC::EventSource::epollFd(), POLLIN, 0 };
+            while (m_running) {
+                if (poll(&pollFd, 1, -1) > 0)
+                    IPC::EventSource::dispatchEpollEvents();
+            }
+        } else
+            g_main_loop_run(loop);
+        m_contextSwitches = ::contextSwitches() - switches;
+
+        m_host.deinitialize();
+        g_main_loop_unref(loop);
+        g_main_context_pop_thread_default(context);
+        g_main_context_unref(context);
+    }
+
+    // IPC::Host::Handler
+    void handleMessage(char* data, size_t size) override
+    {
+        auto& message = IPC::Message::cast(data);
+        switch (message.messageCode) {
+        case Ping:
+        {
+            int64_t sent;
+            std::memcpy(&sent, message.messageData, sizeof(sent));
+            m_latencies.add(now() - sent);
+            m_host.sendMessage(data, size);
+            break;
+        }
+        case Quit:
+            m_running = false;
+            g_main_loop_quit(m_glibLoop);
+            break;
+        }
+    }
+
+    IPC::EventSource::Loop m_loop;
+    IPC::Host m_host;
+    GMainLoop* m_glibLoop { nullptr };
+    bool m_running { true };
+
+    Benchmark::Latencies m_latencies;
+    long m_contextSwitches { 0 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    int m_clientFd { -1 };
+
+    std::thread m_thread;
+};
+
+class ClientHandler final : public IPC::Client::Handler {
+public:
+    // IPC::Client::Handler
+    void handleMessage(char*, size_t) override { }
+};
+
+void run(const char* name, IPC::EventSource::Loop loop, uint64_t iterations)
+{
+    std::unique_ptr<HostThread> host(new HostThread(loop, iterations));
+    ClientHandler handler;
+    IPC::Client client;
+    client.initialize(handler, host->clientFd());
+
+    Benchmark::Latencies roundTrips(iterations);
+    IPC::Message message;
+    message.messageCode = Ping;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        // Long enough for the host thread to go back to sleep
+        usleep(200);
+
+        int64_t sent = now();
+        std::memcpy(message.messageData, &sent, sizeof(sent));
+        client.sendAndReceiveMessage(IPC::Message::data(message), IPC::Message::size, [](char*, size_t) { });
+        roundTrips.add(now() - sent);
+    }
+
+    message.messageCode = Quit;
+    client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    host->join();
+    client.deinitialize();
+
+    std::string prefix = std::string("BM_EventWakeup/") + name;
+    host->latencies().print(prefix);
+    roundTrips.print(prefix + "/round_trip");
+    std::printf("%-48s %14s %12llu context_switches_per_message=%.2f\n", (prefix + "/host_thread").c_str(), "",
+        static_cast<unsigned long long>(iterations), double(host->contextSwitches()) / iterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const uint64_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    Benchmark::printHeader();
+    run("glib", IPC::EventSource::Loop::GLib, iterations);
+    run("epoll", IPC::EventSource::Loop::Epoll, iterations);
+
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    return EXIT_SUCCESS;
+}
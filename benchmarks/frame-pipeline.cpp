@@ -0,0 +1,555 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Runs the whole frame pipeline through the real backend interfaces. The main thread plays the
+// WebProcess: a synthetic WebKit renders with Mesa's surfaceless EGL through
+// android_renderer_backend_egl_target_impl, starting a new frame whenever the previous one has
+// completed. A second thread plays the UI process: view backends are created through
+// android_view_backend_impl and a synthetic consumer displays committed buffers on a vsync clock,
+// after a configurable (and possibly jittery) delay, releasing the buffers it replaces.
+//
+// The WebProcess side mirrors the state of the renderer's buffer pool, which picks the first
+// unlocked buffer and allocates it on first use, so that starvation (every buffer held by the
+// consumer when a frame is due) and allocations can be reported without touching the backend.
+//
+// Usage: bench-frame-pipeline [seconds per scenario] [width] [height]
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <gio/gio.h>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <wpe-android/view-backend.h>
+
+#include "benchmark.h"
+#include "interfaces.h"
+#include "renderer-host-private.h"
+#include "wpe-stub.h"
+
+namespace {
+
+using Clock = Benchmark::Clock;
+using Milliseconds = std::chrono::milliseconds;
+
+// Size of the buffer pools on both sides of the backend
+const size_t s_poolSize = 4;
+const auto s_vsyncInterval = std::chrono::microseconds(16667);
+
+struct Scenario {
+    const char* name;
+    unsigned views;
+    // Time between a commit and its buffer being ready for display, in milliseconds
+    unsigned consumerDelay;
+    // Extra delay, uniformly distributed in [0, consumerJitter]
+    unsigned consumerJitter;
+    // Time a replaced buffer is still held before being released
+    unsigned releaseDelay;
+    // Time between resizes of every view, 0 to never resize
+    unsigned resizeInterval;
+};
+
+const Scenario s_scenarios[] = {
+    { "steady", 1, 0, 0, 0, 0 },
+    { "slow-consumer", 1, 40, 0, 0, 0 },
+    { "jittery-consumer", 1, 2, 30, 0, 0 },
+    { "slow-release", 1, 0, 0, 50, 0 },
+    { "multi-view", 3, 0, 0, 0, 0 },
+    { "resize-storm", 1, 0, 0, 0, 40 },
+};
+
+struct View {
+    const Scenario* scenario { nullptr };
+
+    // Consumer, on the UI thread
+    WPEAndroidViewBackend* backend { nullptr };
+    struct Frame {
+        WPEAndroidBuffer* buffer;
+        Clock::time_point committed;
+        Clock::time_point ready;
+    };
+    std::deque<Frame> queued;
+    WPEAndroidBuffer* displayed { nullptr };
+    std::vector<std::pair<Clock::time_point, WPEAndroidBuffer*>> releases;
+    std::minstd_rand random;
+    Benchmark::Latencies latencies;
+    uint64_t displayedFrames { 0 };
+    uint64_t droppedFrames { 0 };
+
+    // Synthetic WebKit, on the main thread
+    struct wpe_renderer_backend_egl_target* target { nullptr };
+    void* targetData { nullptr };
+    uint32_t width { 0 };
+    uint32_t height { 0 };
+    struct Slot {
+        bool locked { false };
+        bool allocated { false };
+    };
+    std::array<Slot, s_poolSize> slots;
+    bool frameRequested { true };
+    bool starving { false };
+    Clock::time_point starvingSince;
+    uint64_t renderedFrames { 0 };
+    uint64_t starvations { 0 };
+    uint64_t allocations { 0 };
+    double stalledNanoseconds { 0 };
+
+    // Handed over between both threads
+    std::mutex mutex;
+    std::deque<Clock::time_point> commitTimes;
+    // IDs of the buffers whose release has already been dispatched to the backend
+    std::vector<uint32_t> sentReleases;
+};
+
+class UIThread {
+public:
+    UIThread()
+        : m_thread([this] { run(); })
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return !!m_loop; });
+    }
+
+    ~UIThread()
+    {
+        g_main_loop_quit(m_loop);
+        m_thread.join();
+    }
+
+    GMainContext* context() const { return m_context; }
+
+    // Runs function on the UI thread and waits for it to return
+    void invoke(std::function<void()>&& function)
+    {
+        struct Call {
+            std::function<void()> function;
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool done { false };
+        } call;
+        call.function = std::move(function);
+
+        // Same priority as the IPC sources, which could otherwise keep an idle source from running
+        GSource* source = g_idle_source_new();
+        g_source_set_priority(source, G_PRIORITY_DEFAULT);
+        g_source_set_callback(source, [](gpointer data) -> gboolean {
+            auto& call = *static_cast<Call*>(data);
+            call.function();
+            std::lock_guard<std::mutex> lock(call.mutex);
+            call.done = true;
+            call.condition.notify_one();
+            return G_SOURCE_REMOVE;
+        }, &call, nullptr);
+        g_source_attach(source, m_context);
+        g_source_unref(source);
+
+        std::unique_lock<std::mutex> lock(call.mutex);
+        call.condition.wait(lock, [&call] { return call.done; });
+    }
+
+private:
+    void run()
+    {
+        m_context = g_main_context_new();
+        g_main_context_push_thread_default(m_context);
+
+        GMainLoop* loop = g_main_loop_new(m_context, FALSE);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loop = loop;
+        }
+        m_condition.notify_one();
+
+        g_main_loop_run(loop);
+
+        g_main_loop_unref(loop);
+        g_main_context_pop_thread_default(m_context);
+        g_main_context_unref(m_context);
+    }
+
+    GMainContext* m_context { nullptr };
+    GMainLoop* m_loop { nullptr };
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    std::thread m_thread;
+};
+
+// Lives on the UI thread, like the SurfaceControl-based consumers of the backend
+class Consumer {
+public:
+    Consumer(GMainContext* context, std::vector<std::unique_ptr<View>>& views)
+        : m_views(views)
+        , m_nextVsync(Clock::now() + s_vsyncInterval)
+    {
+        for (auto& view : m_views)
+            WPEAndroidViewBackend_setCommitBufferHandler(view->backend, view.get(), commitBuffer);
+
+        m_source = g_timeout_source_new(1);
+        g_source_set_callback(m_source, [](gpointer data) -> gboolean {
+            static_cast<Consumer*>(data)->tick();
+            return G_SOURCE_CONTINUE;
+        }, this, nullptr);
+        g_source_attach(m_source, context);
+    }
+
+    ~Consumer()
+    {
+        g_source_destroy(m_source);
+        g_source_unref(m_source);
+    }
+
+private:
+    static void commitBuffer(void* context, WPEAndroidBuffer* buffer, int fenceFD)
+    {
+        auto& view = *static_cast<View*>(context);
+        if (fenceFD != -1)
+            close(fenceFD);
+
+        auto now = Clock::now();
+        View::Frame frame { buffer, now, now };
+        {
+            std::lock_guard<std::mutex> lock(view.mutex);
+            if (!view.commitTimes.empty()) {
+                frame.committed = view.commitTimes.front();
+                view.commitTimes.pop_front();
+            }
+        }
+
+        unsigned delay = view.scenario->consumerDelay;
+        if (view.scenario->consumerJitter)
+            delay += std::uniform_int_distribution<unsigned>(0, view.scenario->consumerJitter)(view.random);
+        frame.ready += Milliseconds(delay);
+        view.queued.push_back(frame);
+    }
+
+    void tick()
+    {
+        auto now = Clock::now();
+        if (now >= m_nextVsync) {
+            while (m_nextVsync <= now)
+                m_nextVsync += s_vsyncInterval;
+            for (auto& view : m_views)
+                vsync(*view, now);
+        }
+
+        for (auto& view : m_views) {
+            auto& releases = view->releases;
+            auto it = std::partition(releases.begin(), releases.end(),
+                [now](const std::pair<Clock::time_point, WPEAndroidBuffer*>& release) { return release.first > now; });
+            for (auto release = it; release != releases.end(); ++release)
+                releaseBuffer(*view, release->second);
+            releases.erase(it, releases.end());
+        }
+    }
+
+    void vsync(View& view, Clock::time_point now)
+    {
+        // Frames are latched in order, a ready frame replaces the ones ready before it
+        View::Frame latched { nullptr, now, now };
+        while (!view.queued.empty() && view.queued.front().ready <= now) {
+            if (latched.buffer) {
+                view.releases.push_back({ now, latched.buffer });
+                view.droppedFrames++;
+            }
+            latched = view.queued.front();
+            view.queued.pop_front();
+        }
+        if (!latched.buffer)
+            return;
+
+        view.latencies.add(std::chrono::duration<double, std::nano>(now - latched.committed).count());
+        if (view.displayed)
+            view.releases.push_back({ now + Milliseconds(view.scenario->releaseDelay), view.displayed });
+        view.displayed = latched.buffer;
+        view.displayedFrames++;
+
+        // Clock is CLOCK_MONOTONIC, as Choreographer frame times are
+        auto nanoseconds = [](Clock::time_point time) {
+            return int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+        };
+        WPEAndroidViewBackend_dispatchFrameCompleteWithTiming(view.backend, nanoseconds(now), nanoseconds(m_nextVsync));
+    }
+
+    void releaseBuffer(View& view, WPEAndroidBuffer* buffer)
+    {
+        // Buffers purged by a resize are deleted on release, and the renderer is not notified
+        auto* androidBuffer = reinterpret_cast<WPEAndroid::Buffer*>(buffer);
+        bool notifiesRenderer = !androidBuffer->pendingDelete();
+        uint32_t bufferID = androidBuffer->bufferID();
+
+        WPEAndroidViewBackend_dispatchReleaseBuffer(view.backend, buffer);
+
+        if (notifiesRenderer) {
+            std::lock_guard<std::mutex> lock(view.mutex);
+            view.sentReleases.push_back(bufferID);
+        }
+    }
+
+    std::vector<std::unique_ptr<View>>& m_views;
+    Clock::time_point m_nextVsync;
+    GSource* m_source { nullptr };
+};
+
+class WebProcess {
+public:
+    WebProcess(UIThread& ui)
+        : m_ui(ui)
+    {
+        int clientFd = -1;
+        m_ui.invoke([&clientFd] { clientFd = android_renderer_host_impl.create_client(nullptr); });
+        m_backend = android_renderer_backend_egl_impl.create(clientFd);
+
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay) {
+            m_display = getPlatformDisplay(android_renderer_backend_egl_impl.get_platform(m_backend),
+                reinterpret_cast<void*>(android_renderer_backend_egl_impl.get_native_display(m_backend)), nullptr);
+        }
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, nullptr, nullptr))
+            return;
+
+        static const EGLint contextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+        eglBindAPI(EGL_OPENGL_ES_API);
+        m_context = eglCreateContext(m_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+        if (m_context != EGL_NO_CONTEXT)
+            eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context);
+    }
+
+    ~WebProcess()
+    {
+        if (m_context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(m_display, m_context);
+        }
+        if (m_display != EGL_NO_DISPLAY)
+            eglTerminate(m_display);
+        android_renderer_backend_egl_impl.destroy(m_backend);
+    }
+
+    bool isValid() const { return m_context != EGL_NO_CONTEXT; }
+
+    void run(const Scenario&, uint32_t width, uint32_t height, Clock::duration);
+
+private:
+    void createView(View&);
+    void destroyView(View&);
+
+    bool renderFrame(View&);
+    void resize(View&, uint32_t width, uint32_t height);
+
+    UIThread& m_ui;
+    void* m_backend { nullptr };
+    EGLDisplay m_display { EGL_NO_DISPLAY };
+    EGLContext m_context { EGL_NO_CONTEXT };
+};
+
+void WebProcess::createView(View& view)
+{
+    int hostFd = -1;
+    m_ui.invoke([&view, &hostFd] {
+        view.backend = WPEAndroidViewBackend_create(view.width, view.height);
+        auto* wpeBackend = WPEAndroidViewBackend_getWPEViewBackend(view.backend);
+        wpe_view_backend_initialize(wpeBackend);
+        hostFd = wpe_view_backend_get_renderer_host_fd(wpeBackend);
+    });
+
+    View* viewPointer = &view;
+    view.target = WPEStub::createTarget([viewPointer] { viewPointer->frameRequested = true; });
+    view.targetData = android_renderer_backend_egl_target_impl.create(view.target, hostFd);
+    android_renderer_backend_egl_target_impl.initialize(view.targetData, m_backend, view.width, view.height);
+}
+
+void WebProcess::destroyView(View& view)
+{
+    android_renderer_backend_egl_target_impl.deinitialize(view.targetData);
+    android_renderer_backend_egl_target_impl.destroy(view.targetData);
+    WPEStub::destroyTarget(view.target);
+
+    m_ui.invoke([&view] { WPEAndroidViewBackend_destroy(view.backend); });
+}
+
+bool WebProcess::renderFrame(View& view)
+{
+    if (!view.frameRequested)
+        return false;
+
+    auto now = Clock::now();
+    auto slot = std::find_if(view.slots.begin(), view.slots.end(), [](const View::Slot& slot) { return !slot.locked; });
+    if (slot == view.slots.end()) {
+        if (!view.starving) {
+            view.starving = true;
+            view.starvingSince = now;
+            view.starvations++;
+        }
+        return false;
+    }
+    if (view.starving) {
+        view.starving = false;
+        view.stalledNanoseconds += std::chrono::duration<double, std::nano>(now - view.starvingSince).count();
+    }
+    if (!slot->allocated) {
+        slot->allocated = true;
+        view.allocations++;
+    }
+
+    android_renderer_backend_egl_target_impl.frame_will_render(view.targetData);
+
+    float shade = (view.renderedFrames % 64) / 63.f;
+    glViewport(0, 0, view.width, view.height);
+    glClearColor(shade, 1 - shade, 0.5f, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    {
+        // Before the commit is sent, the consumer may receive it right away
+        std::lock_guard<std::mutex> lock(view.mutex);
+        view.commitTimes.push_back(Clock::now());
+    }
+    android_renderer_backend_egl_target_impl.frame_rendered(view.targetData);
+
+    slot->locked = true;
+    view.frameRequested = false;
+    view.renderedFrames++;
+    return true;
+}
+
+void WebProcess::resize(View& view, uint32_t width, uint32_t height)
+{
+    view.width = width;
+    view.height = height;
+    android_renderer_backend_egl_target_impl.resize(view.targetData, width, height);
+
+    // The renderer drops its whole pool and forgets about buffers held by the consumer
+    for (auto& slot : view.slots)
+        slot = View::Slot();
+}
+
+void WebProcess::run(const Scenario& scenario, uint32_t width, uint32_t height, Clock::duration duration)
+{
+    std::vector<std::unique_ptr<View>> views;
+    for (unsigned i = 0; i < scenario.views; ++i) {
+        views.emplace_back(new View);
+        views.back()->scenario = &scenario;
+        views.back()->width = width;
+        views.back()->height = height;
+        createView(*views.back());
+    }
+
+    std::unique_ptr<Consumer> consumer;
+    m_ui.invoke([&] { consumer.reset(new Consumer(m_ui.context(), views)); });
+
+    // Bounds the time spent waiting for messages, releases are only known once their message is processed
+    GMainContext* context = g_main_context_get_thread_default();
+    GSource* timeout = g_timeout_source_new(1);
+    g_source_set_callback(timeout, [](gpointer) -> gboolean { return G_SOURCE_CONTINUE; }, nullptr, nullptr);
+    g_source_attach(timeout, context);
+
+    auto start = Clock::now();
+    auto nextResize = start + Milliseconds(scenario.resizeInterval);
+    bool shrunk = false;
+    while (Clock::now() - start < duration) {
+        // Releases sent before dispatching pending messages have been processed by the renderer afterwards
+        std::vector<std::vector<uint32_t>> releases(views.size());
+        for (size_t i = 0; i < views.size(); ++i) {
+            std::lock_guard<std::mutex> lock(views[i]->mutex);
+            releases[i].swap(views[i]->sentReleases);
+        }
+        while (g_main_context_iteration(context, FALSE)) { }
+        for (size_t i = 0; i < views.size(); ++i) {
+            for (uint32_t bufferID : releases[i]) {
+                if (bufferID < s_poolSize)
+                    views[i]->slots[bufferID].locked = false;
+            }
+        }
+
+        if (scenario.resizeInterval && Clock::now() >= nextResize) {
+            nextResize += Milliseconds(scenario.resizeInterval);
+            shrunk = !shrunk;
+            for (auto& view : views)
+                resize(*view, shrunk ? width * 3 / 4 : width, shrunk ? height * 3 / 4 : height);
+        }
+
+        bool rendered = false;
+        for (auto& view : views)
+            rendered |= renderFrame(*view);
+        if (!rendered)
+            g_main_context_iteration(context, TRUE);
+    }
+    double elapsed = Benchmark::nanosecondsSince(start);
+
+    g_source_destroy(timeout);
+    g_source_unref(timeout);
+
+    // Nothing may be left in the backend's socket, the next pool construction expects its reply first
+    m_ui.invoke([&consumer] { consumer = nullptr; });
+    while (g_main_context_iteration(context, FALSE)) { }
+    for (auto& view : views)
+        destroyView(*view);
+
+    for (size_t i = 0; i < views.size(); ++i) {
+        auto& view = *views[i];
+        if (view.starving)
+            view.stalledNanoseconds += Benchmark::nanosecondsSince(view.starvingSince);
+
+        std::string name = std::string("BM_FramePipeline/") + scenario.name + "/view:" + std::to_string(i);
+        std::printf("%-48s %11.0f ns %12llu fps=%.1f rendered=%llu dropped=%llu starvations=%llu stalled=%.1fms allocations=%llu\n",
+            name.c_str(), view.displayedFrames ? elapsed / view.displayedFrames : 0.,
+            static_cast<unsigned long long>(view.displayedFrames), view.displayedFrames / (elapsed / 1e9),
+            static_cast<unsigned long long>(view.renderedFrames), static_cast<unsigned long long>(view.droppedFrames),
+            static_cast<unsigned long long>(view.starvations), view.stalledNanoseconds / 1e6,
+            static_cast<unsigned long long>(view.allocations));
+        view.latencies.print(name + "/commit_to_display");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 2;
+    const uint32_t width = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 720;
+    const uint32_t height = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1280;
+
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    int status = EXIT_SUCCESS;
+    {
+        UIThread ui;
+        WebProcess webProcess(ui);
+        if (webProcess.isValid()) {
+            Benchmark::printHeader();
+            auto duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+            for (auto& scenario : s_scenarios)
+                webProcess.run(scenario, width, height, duration);
+        } else {
+            std::fprintf(stderr, "bench-frame-pipeline: cannot create a surfaceless EGL context\n");
+            status = EXIT_FAILURE;
+        }
+    }
+
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    return status;
+}
@@ -0,0 +1,597 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Plays an IPC capture (see src/ipc-capture.h) back into the UI process side of the backend:
+// the renderer host, its client proxies and the view backends, with no WebProcess nor WebKit.
+// Renderer messages are sent through IPC::Client endpoints as the renderer would, along with
+// fresh buffers matching the recorded descriptions. Buffer releases and frame completions are
+// dispatched by a synthetic application when the host sent the corresponding feedback during
+// the capture. View and pool IDs are assigned anew by the host and mapped on the fly.
+//
+// Reports the time the host takes to handle each kind of message and the peak of memory used,
+// so that captures of heavy pages make for repeatable performance and memory benchmarks.
+//
+// Usage: bench-ipc-replay <capture file> [speed]
+//   speed scales the recorded timing, 2 replays twice as fast and 0 as fast as possible (default 1)
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <gio/gio.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#include <wpe-android/view-backend.h>
+
+#include "benchmark.h"
+#include "interfaces.h"
+#include "ipc-capture.h"
+#include "ipc-messages.h"
+#include "platform.h"
+#include "renderer-host-private.h"
+#include "shared-memory.h"
+#include "wpe-stub.h"
+
+namespace {
+
+using Record = IPC::Capture::Record;
+using RecordType = IPC::Capture::RecordType;
+using BufferKey = std::pair<uint32_t, uint32_t>;
+
+bool loadCapture(const char* path, std::vector<Record>& records)
+{
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        std::fprintf(stderr, "bench-ipc-replay: cannot open %s: %s\n", path, std::strerror(errno));
+        return false;
+    }
+
+    IPC::Capture::FileHeader header;
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1
+        && !std::memcmp(header.magic, IPC::Capture::s_magic, sizeof(header.magic))
+        && header.version == IPC::Capture::s_version && header.recordSize == sizeof(Record);
+    if (valid) {
+        Record record;
+        while (std::fread(&record, sizeof(record), 1, file) == 1)
+            records.push_back(record);
+    } else
+        std::fprintf(stderr, "bench-ipc-replay: %s is not a capture of version %u\n", path, IPC::Capture::s_version);
+
+    std::fclose(file);
+    return valid;
+}
+
+const char* messageName(uint64_t code)
+{
+    switch (code) {
+    case IPC::PoolConstruction::code:
+        return "PoolConstruction";
+    case IPC::PoolPurge::code:
+        return "PoolPurge";
+    case IPC::UnregisterPool::code:
+        return "UnregisterPool";
+    case IPC::BufferAllocation::code:
+        return "BufferAllocation";
+    case IPC::SharedMemoryBufferAllocation::code:
+        return "SharedMemoryBufferAllocation";
+    case IPC::BufferCommit::code:
+        return "BufferCommit";
+    case IPC::ViewIdentity::code:
+        return "ViewIdentity";
+    case IPC::FrameFeedback::code:
+        return "FrameFeedback";
+    case IPC::Handshake::code:
+        return "Handshake";
+    case IPC::HandshakeReply::code:
+        return "HandshakeReply";
+    case IPC::PoolFormat::code:
+        return "PoolFormat";
+    case IPC::PoolVisibility::code:
+        return "PoolVisibility";
+    case IPC::PoolPark::code:
+        return "PoolPark";
+    }
+    return "Unknown";
+}
+
+// Every message but PoolConstruction, ViewIdentity and the handshake starts with a pool ID
+uint32_t& poolIDOf(IPC::Message& message)
+{
+    return *reinterpret_cast<uint32_t*>(message.messageData);
+}
+
+struct Endpoint final : public IPC::Client::Handler {
+    bool isView { false };
+    IPC::Client client;
+
+    // Views only, their ID in this run and the buffers committed and not released yet by the
+    // application
+    WPEAndroidViewBackend* backend { nullptr };
+    uint32_t viewID { 0 };
+    std::map<BufferKey, WPEAndroidBuffer*> committed;
+
+    // Renderers only, pool IDs replied by the host not yet matched with a recorded reply, and the
+    // views of the pools under construction
+    std::deque<uint32_t> constructedPools;
+    std::deque<Endpoint*> constructingViews;
+
+    void handleMessage(char* data, size_t size) override
+    {
+        auto& message = IPC::Message::cast(data);
+        if (message.messageCode == IPC::PoolConstructionReply::code)
+            constructedPools.push_back(IPC::PoolConstructionReply::from(message).poolID);
+    }
+};
+
+class Replay {
+public:
+    Replay(std::vector<Record>&& records, double speed)
+        : m_records(std::move(records))
+        , m_speed(speed)
+        , m_context(g_main_context_get_thread_default())
+    {
+        m_fence = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        // Views are the endpoints handing out their identity
+        for (auto& record : m_records) {
+            if (record.type == RecordType::Sent && record.message.messageCode == IPC::ViewIdentity::code)
+                m_viewEndpoints.insert(record.endpoint);
+        }
+    }
+
+    ~Replay()
+    {
+        for (auto& it : m_endpoints)
+            closeEndpoint(*it.second);
+        drain();
+        close(m_fence);
+    }
+
+    void run(const std::string& name);
+
+private:
+    void replay(const Record&);
+
+    Endpoint& endpoint(uint32_t id);
+    void closeEndpoint(Endpoint&);
+    bool mapPool(IPC::Message&);
+    void identifyView(Endpoint&, const IPC::Message& identity);
+    void constructPool(Endpoint&, IPC::Message&);
+
+    void sendToHost(Endpoint&, IPC::Message&, std::function<void()>&& afterMessage = nullptr);
+    void allocateHardwareBuffer(Endpoint&, const IPC::Message& description);
+    void allocateSharedMemoryBuffer(Endpoint&, IPC::Message&);
+    void matchConstructedPool(Endpoint&, const IPC::Message& reply);
+    void frameFeedback(const IPC::Message&);
+
+    static void commitBuffer(void* context, WPEAndroidBuffer*, int fenceFD);
+
+    void drain() { while (g_main_context_iteration(m_context, FALSE)) { } }
+    bool pumpUntil(const std::function<bool()>& condition, int64_t timeout);
+    void waitUntil(int64_t time);
+    void sampleMemory();
+
+    std::vector<Record> m_records;
+    double m_speed;
+    GMainContext* m_context;
+    int m_fence { -1 };
+
+    std::set<uint32_t> m_viewEndpoints;
+    std::map<uint32_t, std::unique_ptr<Endpoint>> m_endpoints;
+    // Recorded view IDs to the views of this run
+    std::map<uint32_t, Endpoint*> m_views;
+    // Recorded pool IDs to the ones of this run
+    std::map<uint32_t, uint32_t> m_pools;
+    std::map<uint32_t, Endpoint*> m_poolViews;
+
+    std::map<std::string, Benchmark::Latencies> m_latencies;
+    uint64_t m_replayed { 0 };
+    uint64_t m_skipped { 0 };
+    uint64_t m_allocatedBytes { 0 };
+    uint64_t m_peakLiveBufferBytes { 0 };
+};
+
+Endpoint& Replay::endpoint(uint32_t id)
+{
+    auto& endpoint = m_endpoints[id];
+    if (endpoint)
+        return *endpoint;
+
+    endpoint.reset(new Endpoint);
+    endpoint->isView = m_viewEndpoints.count(id);
+
+    if (endpoint->isView) {
+        // The size only matters to WebKit
+        endpoint->backend = WPEAndroidViewBackend_create(1, 1);
+        WPEAndroidViewBackend_setCommitBufferHandler(endpoint->backend, endpoint.get(), commitBuffer);
+        wpe_view_backend_initialize(WPEAndroidViewBackend_getWPEViewBackend(endpoint->backend));
+    } else
+        endpoint->client.initialize(*endpoint, android_renderer_host_impl.create_client(nullptr));
+    return *endpoint;
+}
+
+void Replay::closeEndpoint(Endpoint& endpoint)
+{
+    // Renderer endpoints stay open, the host does not expect its clients to go away
+    if (!endpoint.isView || !endpoint.backend)
+        return;
+
+    for (auto it = m_poolViews.begin(); it != m_poolViews.end();) {
+        if (it->second == &endpoint)
+            it = m_poolViews.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = m_views.begin(); it != m_views.end();) {
+        if (it->second == &endpoint)
+            it = m_views.erase(it);
+        else
+            ++it;
+    }
+
+    endpoint.committed.clear();
+    WPEAndroidViewBackend_destroy(endpoint.backend);
+    endpoint.backend = nullptr;
+}
+
+bool Replay::mapPool(IPC::Message& message)
+{
+    auto it = m_pools.find(poolIDOf(message));
+    if (it == m_pools.end())
+        return false;
+
+    poolIDOf(message) = it->second;
+    return true;
+}
+
+void Replay::identifyView(Endpoint& endpoint, const IPC::Message& identity)
+{
+    // As a renderer target would, only to learn the ID of the view in this run
+    int fd = wpe_view_backend_get_renderer_host_fd(WPEAndroidViewBackend_getWPEViewBackend(endpoint.backend));
+    IPC::Message message;
+    if (fd == -1 || !IPC::readMessageSocket(fd, IPC::Message::data(message), IPC::Message::size)) {
+        m_skipped++;
+        return;
+    }
+
+    endpoint.viewID = IPC::ViewIdentity::from(message).viewID;
+    m_views[IPC::ViewIdentity::from(identity).viewID] = &endpoint;
+}
+
+void Replay::constructPool(Endpoint& endpoint, IPC::Message& message)
+{
+    // Pools of views that are unknown to this run are constructed all the same, their frames
+    // are dropped by the host
+    auto construction = IPC::PoolConstruction::from(message);
+    auto view = m_views.find(construction.viewID);
+    construction.viewID = view != m_views.end() ? view->second->viewID : 0;
+    IPC::PoolConstruction::construct(message, construction);
+
+    endpoint.constructingViews.push_back(view != m_views.end() ? view->second : nullptr);
+    sendToHost(endpoint, message);
+}
+
+void Replay::sendToHost(Endpoint& endpoint, IPC::Message& message, std::function<void()>&& afterMessage)
+{
+    // The host runs on this thread, the message is handled by the time the context is drained
+    auto start = Benchmark::Clock::now();
+    endpoint.client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    if (afterMessage)
+        afterMessage();
+    drain();
+    m_latencies[std::string("handle/") + messageName(message.messageCode)].add(Benchmark::nanosecondsSince(start));
+}
+
+void Replay::allocateHardwareBuffer(Endpoint& endpoint, const IPC::Message& description)
+{
+    auto allocation = IPC::SharedMemoryBufferAllocation::from(description);
+
+    AHardwareBuffer_Desc bufferDescription = { };
+    bufferDescription.width = allocation.width;
+    bufferDescription.height = allocation.height;
+    bufferDescription.layers = 1;
+    bufferDescription.format = allocation.format == AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM ? AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM : AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
+    bufferDescription.usage = AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE | AHARDWAREBUFFER_USAGE_GPU_FRAMEBUFFER;
+
+    AHardwareBuffer* buffer = nullptr;
+    if (WPEAndroid::Platform::allocateBuffer(&bufferDescription, &buffer)) {
+        m_skipped++;
+        return;
+    }
+
+    IPC::BufferAllocation bufferAllocation = { };
+    bufferAllocation.poolID = allocation.poolID;
+    bufferAllocation.bufferID = allocation.bufferID;
+
+    IPC::Message message;
+    IPC::BufferAllocation::construct(message, bufferAllocation);
+    sendToHost(endpoint, message, [&endpoint, buffer] { WPEAndroid::Platform::sendBuffer(buffer, endpoint.client.socketFd()); });
+    WPEAndroid::Platform::releaseBuffer(buffer);
+
+    m_allocatedBytes += uint64_t(allocation.width) * allocation.height * 4;
+}
+
+void Replay::allocateSharedMemoryBuffer(Endpoint& endpoint, IPC::Message& message)
+{
+    auto allocation = IPC::SharedMemoryBufferAllocation::from(message);
+
+    WPEAndroid::SharedMemory memory;
+    if (!memory.allocate(size_t(allocation.stride) * allocation.height)) {
+        m_skipped++;
+        return;
+    }
+
+    int fd = memory.fd();
+    sendToHost(endpoint, message, [&endpoint, fd] { endpoint.client.sendFileDescriptor(fd); });
+
+    m_allocatedBytes += uint64_t(allocation.stride) * allocation.height;
+}
+
+void Replay::matchConstructedPool(Endpoint& endpoint, const IPC::Message& reply)
+{
+    if (!pumpUntil([&endpoint] { return !endpoint.constructedPools.empty(); }, G_USEC_PER_SEC)) {
+        m_skipped++;
+        return;
+    }
+
+    uint32_t poolID = endpoint.constructedPools.front();
+    m_pools[IPC::PoolConstructionReply::from(reply).poolID] = poolID;
+    endpoint.constructedPools.pop_front();
+
+    if (!endpoint.constructingViews.empty()) {
+        if (auto* view = endpoint.constructingViews.front())
+            m_poolViews[poolID] = view;
+        endpoint.constructingViews.pop_front();
+    }
+}
+
+void Replay::frameFeedback(const IPC::Message& recorded)
+{
+    auto feedback = IPC::FrameFeedback::from(recorded);
+    auto pool = m_pools.find(feedback.poolID);
+    auto view = pool != m_pools.end() ? m_poolViews.find(pool->second) : m_poolViews.end();
+    if (view == m_poolViews.end()) {
+        m_skipped++;
+        return;
+    }
+
+    // What the application did during the loop iteration that produced the feedback
+    auto start = Benchmark::Clock::now();
+    auto& committed = view->second->committed;
+    for (uint32_t bufferID = 0; feedback.releasedBuffers >> bufferID; ++bufferID) {
+        if (!(feedback.releasedBuffers & (1 << bufferID)))
+            continue;
+
+        auto buffer = committed.find({ pool->second, bufferID });
+        if (buffer == committed.end()) {
+            m_skipped++;
+            continue;
+        }
+        WPEAndroidViewBackend_dispatchReleaseBuffer(view->second->backend, buffer->second);
+        committed.erase(buffer);
+    }
+    if (feedback.frameComplete)
+        WPEAndroidViewBackend_dispatchFrameComplete(view->second->backend);
+    drain();
+    m_latencies["dispatch/FrameFeedback"].add(Benchmark::nanosecondsSince(start));
+}
+
+void Replay::commitBuffer(void* context, WPEAndroidBuffer* buffer, int fenceFD)
+{
+    auto& endpoint = *static_cast<Endpoint*>(context);
+    if (fenceFD != -1)
+        close(fenceFD);
+
+    // Buffers purged by a resize get no ReleaseBuffer message, applications release them once
+    // replaced by a new frame
+    for (auto it = endpoint.committed.begin(); it != endpoint.committed.end();) {
+        if (reinterpret_cast<WPEAndroid::Buffer*>(it->second)->pendingDelete()) {
+            WPEAndroidViewBackend_dispatchReleaseBuffer(endpoint.backend, it->second);
+            it = endpoint.committed.erase(it);
+        } else
+            ++it;
+    }
+
+    auto* androidBuffer = reinterpret_cast<WPEAndroid::Buffer*>(buffer);
+    endpoint.committed[{ androidBuffer->poolID(), androidBuffer->bufferID() }] = buffer;
+}
+
+void Replay::replay(const Record& record)
+{
+    if (record.type == RecordType::EndpointClosed) {
+        auto it = m_endpoints.find(record.endpoint);
+        if (it != m_endpoints.end())
+            closeEndpoint(*it->second);
+        return;
+    }
+
+    auto& endpoint = Replay::endpoint(record.endpoint);
+    IPC::Message message = record.message;
+
+    switch (record.type) {
+    case RecordType::EndpointOpened:
+    case RecordType::EndpointClosed:
+        return;
+    case RecordType::BufferDescription:
+        if (!mapPool(message)) {
+            m_skipped++;
+            return;
+        }
+        allocateHardwareBuffer(endpoint, message);
+        break;
+    case RecordType::Sent:
+        if (message.messageCode == IPC::ViewIdentity::code)
+            identifyView(endpoint, message);
+        else if (message.messageCode == IPC::PoolConstructionReply::code)
+            matchConstructedPool(endpoint, message);
+        else if (message.messageCode == IPC::FrameFeedback::code)
+            frameFeedback(message);
+        break;
+    case RecordType::Received:
+        if (message.messageCode == IPC::PoolConstruction::code) {
+            constructPool(endpoint, message);
+            break;
+        }
+        if (message.messageCode == IPC::Handshake::code) {
+            sendToHost(endpoint, message);
+            break;
+        }
+        if (!mapPool(message)) {
+            m_skipped++;
+            return;
+        }
+
+        switch (message.messageCode) {
+        case IPC::BufferAllocation::code:
+            // Sent along with the buffer once its description, which follows, is replayed
+            return;
+        case IPC::SharedMemoryBufferAllocation::code:
+            allocateSharedMemoryBuffer(endpoint, message);
+            break;
+        case IPC::BufferCommit::code:
+        {
+            bool hasFence = IPC::BufferCommit::from(message).hasFence;
+            int fence = m_fence;
+            sendToHost(endpoint, message, [&endpoint, hasFence, fence] {
+                if (hasFence)
+                    endpoint.client.sendFileDescriptor(fence);
+            });
+            break;
+        }
+        default:
+            sendToHost(endpoint, message);
+            break;
+        }
+        break;
+    }
+
+    m_replayed++;
+}
+
+bool Replay::pumpUntil(const std::function<bool()>& condition, int64_t timeout)
+{
+    int64_t deadline = g_get_monotonic_time() + timeout;
+    GSource* tick = g_timeout_source_new(1);
+    g_source_set_callback(tick, [](gpointer) -> gboolean { return G_SOURCE_CONTINUE; }, nullptr, nullptr);
+    g_source_attach(tick, m_context);
+
+    while (!condition() && g_get_monotonic_time() < deadline)
+        g_main_context_iteration(m_context, TRUE);
+
+    g_source_destroy(tick);
+    g_source_unref(tick);
+    return condition();
+}
+
+void Replay::waitUntil(int64_t time)
+{
+    int64_t now = g_get_monotonic_time();
+    if (time <= now)
+        return;
+
+    GSource* timeout = g_timeout_source_new(std::max<int64_t>(1, (time - now) / 1000));
+    bool fired = false;
+    g_source_set_callback(timeout, [](gpointer data) -> gboolean {
+        *static_cast<bool*>(data) = true;
+        return G_SOURCE_REMOVE;
+    }, &fired, nullptr);
+    g_source_attach(timeout, m_context);
+
+    while (!fired)
+        g_main_context_iteration(m_context, TRUE);
+    g_source_unref(timeout);
+}
+
+void Replay::sampleMemory()
+{
+    uint64_t liveBufferBytes = 0;
+    for (auto& it : m_endpoints) {
+        if (!it.second->backend)
+            continue;
+
+        WPEAndroidViewBackendStatistics statistics;
+        WPEAndroidViewBackend_getStatistics(it.second->backend, &statistics);
+        liveBufferBytes += statistics.liveBufferBytes;
+    }
+    m_peakLiveBufferBytes = std::max(m_peakLiveBufferBytes, liveBufferBytes);
+}
+
+void Replay::run(const std::string& name)
+{
+    int64_t start = g_get_monotonic_time();
+    for (auto& record : m_records) {
+        if (m_speed > 0)
+            waitUntil(start + int64_t(record.timestamp / m_speed));
+        replay(record);
+        sampleMemory();
+    }
+    drain();
+    double elapsed = (g_get_monotonic_time() - start) * 1e3;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::string prefix = "BM_IPCReplay/" + name;
+    std::printf("%-48s %11.0f ns %12llu replayed=%llu skipped=%llu duration=%.1fms speed=%g\n",
+        prefix.c_str(), m_records.empty() ? 0. : elapsed / m_records.size(),
+        static_cast<unsigned long long>(m_records.size()), static_cast<unsigned long long>(m_replayed),
+        static_cast<unsigned long long>(m_skipped), elapsed / 1e6, m_speed);
+    for (auto& it : m_latencies)
+        it.second.print(prefix + "/" + it.first);
+    std::printf("%-48s %14s %12s allocated=%.1fMB peak_live_buffers=%.1fMB max_rss=%.1fMB\n",
+        (prefix + "/memory").c_str(), "", "", m_allocatedBytes / 1048576., m_peakLiveBufferBytes / 1048576., usage.ru_maxrss / 1024.);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <capture file> [speed]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const double speed = argc > 2 ? std::strtod(argv[2], nullptr) : 1;
+
+    std::vector<Record> records;
+    if (!loadCapture(argv[1], records))
+        return EXIT_FAILURE;
+
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    {
+        std::string name = argv[1];
+        name = name.substr(name.find_last_of('/') + 1);
+
+        Replay replay(std::move(records), speed);
+        Benchmark::printHeader();
+        replay.run(name);
+    }
+
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Measures the cost of the IPC::Host/IPC::Client transport: IPC::Host runs on its own thread
+// and main context, as in the UI process, IPC::Client on the main thread, as in the WebProcess.
+//
+// Usage: bench-ipc [iterations]
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "ipc.h"
+#include "ipc-messages.h"
+
+namespace {
+
+// Message codes private to the benchmark, away from the ones in ipc-messages.h
+enum MessageCode : uint64_t {
+    Echo = 1000,
+    Count,
+    FileDescriptor,
+};
+
+class HostThread final : public IPC::Host::Handler {
+public:
+    HostThread()
+        : m_thread([this] { run(); })
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_clientFd != -1; });
+    }
+
+    ~HostThread()
+    {
+        while (!m_loop)
+            std::this_thread::yield();
+        g_main_loop_quit(m_loop);
+        m_thread.join();
+    }
+
+    int clientFd() const { return m_clientFd; }
+    uint64_t received() const { return m_received.load(std::memory_order_acquire); }
+
+private:
+    void run()
+    {
+        GMainContext* context = g_main_context_new();
+        g_main_context_push_thread_default(context);
+
+        m_host.initialize(*this);
+        GMainLoop* loop = g_main_loop_new(context, FALSE);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_clientFd = m_host.releaseClientFD(true);
+            m_loop = loop;
+        }
+        m_condition.notify_one();
+
+        g_main_loop_run(loop);
+
+        m_host.deinitialize();
+        g_main_loop_unref(loop);
+        g_main_context_pop_thread_default(context);
+        g_main_context_unref(context);
+    }
+
+    // IPC::Host::Handler
+    void handleMessage(char* data, size_t size) override
+    {
+        auto& message = IPC::Message::cast(data);
+        switch (message.messageCode) {
+        case Echo:
+            m_host.sendMessage(data, size);
+            break;
+        case IPC::PoolConstruction::code:
+        {
+            IPC::PoolConstructionReply reply;
+            reply.poolID = 1;
+
+            IPC::Message replyMessage;
+            IPC::PoolConstructionReply::construct(replyMessage, reply);
+            m_host.sendMessage(IPC::Message::data(replyMessage), IPC::Message::size);
+            break;
+        }
+        case FileDescriptor:
+        {
+            int fd = -EAGAIN;
+            while (fd == -EAGAIN)
+                fd = m_host.receiveFileDescriptor();
+            if (fd >= 0)
+                close(fd);
+            m_received.fetch_add(1, std::memory_order_release);
+            break;
+        }
+        case Count:
+            m_received.fetch_add(1, std::memory_order_release);
+            break;
+        }
+    }
+
+    IPC::Host m_host;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    int m_clientFd { -1 };
+    GMainLoop* m_loop { nullptr };
+    std::atomic<uint64_t> m_received { 0 };
+
+    std::thread m_thread;
+};
+
+class ClientHandler final : public IPC::Client::Handler {
+public:
+    uint64_t received { 0 };
+
+    // IPC::Client::Handler
+    void handleMessage(char*, size_t) override { received++; }
+};
+
+void waitForHost(const HostThread& host, uint64_t expected)
+{
+    while (host.received() < expected)
+        std::this_thread::yield();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const uint64_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    HostThread host;
+    ClientHandler handler;
+    IPC::Client client;
+    client.initialize(handler, host.clientFd());
+
+    Benchmark::printHeader();
+
+    {
+        // Round trip of a single message: client -> host -> client, dispatched through both main contexts
+        Benchmark::Latencies latencies(iterations);
+        IPC::Message message;
+        message.messageCode = Echo;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            auto start = Benchmark::Clock::now();
+            uint64_t expected = handler.received + 1;
+            client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+            while (handler.received < expected)
+                g_main_context_iteration(context, TRUE);
+            latencies.add(Benchmark::nanosecondsSince(start));
+        }
+        latencies.print("BM_MessageRoundTrip");
+    }
+
+    {
+        // One-way streaming, until the host has dispatched every message
+        uint64_t base = host.received();
+        IPC::Message message;
+        message.messageCode = Count;
+        auto start = Benchmark::Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+            client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        waitForHost(host, base + iterations);
+        Benchmark::printThroughput("BM_MessageThroughput", iterations, Benchmark::nanosecondsSince(start), "messages");
+    }
+
+    {
+        // Message followed by a file descriptor, as for buffer commits and their fences
+        int fds[2];
+        if (pipe(fds) == -1)
+            return EXIT_FAILURE;
+
+        uint64_t base = host.received();
+        IPC::Message message;
+        message.messageCode = FileDescriptor;
+        auto start = Benchmark::Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+            client.sendFileDescriptor(fds[0]);
+            // Keep the number of descriptors in flight bounded by the socket buffer
+            if (!(i % 64))
+                waitForHost(host, base + i + 1);
+        }
+        waitForHost(host, base + iterations);
+        Benchmark::printThroughput("BM_FileDescriptorThroughput", iterations, Benchmark::nanosecondsSince(start), "descriptors");
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    {
+        // Synchronous request/reply, as used for pool construction
+        Benchmark::Latencies latencies(iterations);
+        IPC::Message message;
+        IPC::PoolConstruction::construct(message, IPC::PoolConstruction());
+        for (uint64_t i = 0; i < iterations; ++i) {
+            auto start = Benchmark::Clock::now();
+            client.sendAndReceiveMessage(IPC::Message::data(message), IPC::Message::size, [](char*, size_t) { });
+            latencies.add(Benchmark::nanosecondsSince(start));
+        }
+        latencies.print("BM_SendAndReceiveMessage");
+    }
+
+    client.deinitialize();
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    return EXIT_SUCCESS;
+}
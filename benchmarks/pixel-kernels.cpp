@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Compares every pixel kernel implementation supported by the running CPU against the scalar
+// reference, on a full HD frame. Output follows the Google Benchmark console format.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "pixel-kernels.h"
+
+using namespace WPEAndroid;
+
+static const uint32_t s_width = 1920;
+static const uint32_t s_height = 1080;
+static const uint32_t s_stride = s_width * 4;
+
+static std::vector<uint8_t> premultipliedFrame()
+{
+    std::vector<uint8_t> frame(size_t(s_stride) * s_height);
+    std::mt19937 random(42);
+    for (size_t i = 0; i < frame.size(); i += 4) {
+        uint8_t alpha = random() & 0xff;
+        for (int c = 0; c < 3; ++c)
+            frame[i + c] = alpha ? uint8_t(random() % (alpha + 1)) : 0;
+        frame[i + 3] = alpha;
+    }
+    return frame;
+}
+
+static void runBenchmark(const std::string& name, size_t bytes, const std::function<void()>& body)
+{
+    using Clock = std::chrono::steady_clock;
+
+    body();
+
+    // Grow the iteration count until a run takes long enough to be measured reliably
+    uint64_t iterations = 1;
+    double elapsed = 0;
+    while (true) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+            body();
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed > 0.5 || iterations > (1u << 20))
+            break;
+        iterations *= elapsed > 0.01 ? std::max<uint64_t>(2, uint64_t(0.6 / elapsed)) : 10;
+    }
+
+    double perIteration = elapsed / iterations;
+    std::printf("%-40s %12.0f ns %12llu %10.2f GiB/s\n", name.c_str(), perIteration * 1e9,
+        static_cast<unsigned long long>(iterations), bytes / perIteration / (1024. * 1024. * 1024.));
+}
+
+static bool verify(const char* kernel, const PixelKernels::Kernels& kernels, const std::vector<uint8_t>& expected, const std::vector<uint8_t>& result)
+{
+    if (expected == result)
+        return true;
+    std::fprintf(stderr, "%s/%s does not match the scalar reference\n", kernel, kernels.name);
+    return false;
+}
+
+int main(int, char**)
+{
+    const std::vector<uint8_t> source = premultipliedFrame();
+    const auto& scalar = PixelKernels::scalarKernels();
+    const uint32_t halfWidth = s_width / 2;
+    const uint32_t halfHeight = s_height / 2;
+
+    std::vector<uint8_t> expectedSwizzle(source.size());
+    std::vector<uint8_t> expectedUnpremultiply(source.size());
+    std::vector<uint8_t> expectedHalve(size_t(halfWidth) * 4 * halfHeight);
+    PixelKernels::swizzleRGBAToBGRA(scalar, source.data(), s_stride, expectedSwizzle.data(), s_stride, s_width, s_height);
+    PixelKernels::unpremultiply(scalar, source.data(), s_stride, expectedUnpremultiply.data(), s_stride, s_width, s_height);
+    PixelKernels::boxDownscale(scalar, source.data(), s_width, s_height, s_stride,
+        expectedHalve.data(), halfWidth, halfHeight, halfWidth * 4);
+
+    std::printf("%-40s %15s %12s %16s\n", "Benchmark", "Time", "Iterations", "Throughput");
+    std::printf("%s\n", std::string(86, '-').c_str());
+
+    bool matches = true;
+    for (auto* kernels : PixelKernels::availableKernels()) {
+        std::string suffix = std::string("/") + kernels->name + "/" + std::to_string(s_width) + "x" + std::to_string(s_height);
+        std::vector<uint8_t> result(source.size());
+
+        runBenchmark("BM_SwizzleRGBAToBGRA" + suffix, source.size(), [&] {
+            PixelKernels::swizzleRGBAToBGRA(*kernels, source.data(), s_stride, result.data(), s_stride, s_width, s_height);
+        });
+        matches &= verify("swizzleRGBAToBGRA", *kernels, expectedSwizzle, result);
+
+        runBenchmark("BM_Unpremultiply" + suffix, source.size(), [&] {
+            PixelKernels::unpremultiply(*kernels, source.data(), s_stride, result.data(), s_stride, s_width, s_height);
+        });
+        matches &= verify("unpremultiply", *kernels, expectedUnpremultiply, result);
+
+        result.resize(expectedHalve.size());
+        runBenchmark("BM_BoxDownscaleHalf" + suffix, source.size(), [&] {
+            PixelKernels::boxDownscale(*kernels, source.data(), s_width, s_height, s_stride,
+                result.data(), halfWidth, halfHeight, halfWidth * 4);
+        });
+        matches &= verify("boxDownscale", *kernels, expectedHalve, result);
+    }
+
+    return matches ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "wpe-stub.h"
+
+struct wpe_view_backend {
+    struct wpe_view_backend_interface* interface;
+    void* interfaceData;
+};
+
+struct wpe_renderer_backend_egl_target {
+    WPEStub::FrameCompleteCallback frameComplete;
+};
+
+struct wpe_view_backend* wpe_view_backend_create_with_backend_interface(struct wpe_view_backend_interface* interface, void* data)
+{
+    auto* backend = new wpe_view_backend;
+    backend->interface = interface;
+    backend->interfaceData = interface->create(data, backend);
+    return backend;
+}
+
+void wpe_view_backend_destroy(struct wpe_view_backend* backend)
+{
+    backend->interface->destroy(backend->interfaceData);
+    delete backend;
+}
+
+void wpe_view_backend_initialize(struct wpe_view_backend* backend)
+{
+    backend->interface->initialize(backend->interfaceData);
+}
+
+int wpe_view_backend_get_renderer_host_fd(struct wpe_view_backend* backend)
+{
+    return backend->interface->get_renderer_host_fd(backend->interfaceData);
+}
+
+void wpe_view_backend_dispatch_set_size(struct wpe_view_backend*, uint32_t, uint32_t)
+{
+}
+
+void wpe_view_backend_dispatch_frame_displayed(struct wpe_view_backend*)
+{
+}
+
+void wpe_view_backend_dispatch_touch_event(struct wpe_view_backend*, struct wpe_input_touch_event*)
+{
+}
+
+void wpe_view_backend_dispatch_pointer_event(struct wpe_view_backend*, struct wpe_input_pointer_event*)
+{
+}
+
+void wpe_view_backend_dispatch_keyboard_event(struct wpe_view_backend*, struct wpe_input_keyboard_event*)
+{
+}
+
+void wpe_view_backend_add_activity_state(struct wpe_view_backend*, uint32_t)
+{
+}
+
+void wpe_view_backend_remove_activity_state(struct wpe_view_backend*, uint32_t)
+{
+}
+
+void wpe_renderer_backend_egl_target_dispatch_frame_complete(struct wpe_renderer_backend_egl_target* target)
+{
+    if (target->frameComplete)
+        target->frameComplete();
+}
+
+namespace WPEStub {
+
+struct wpe_renderer_backend_egl_target* createTarget(FrameCompleteCallback&& frameComplete)
+{
+    auto* target = new wpe_renderer_backend_egl_target;
+    target->frameComplete = std::move(frameComplete);
+    return target;
+}
+
+void destroyTarget(struct wpe_renderer_backend_egl_target* target)
+{
+    delete target;
+}
+
+} // namespace WPEStub
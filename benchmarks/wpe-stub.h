@@ -0,0 +1,35 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Just enough of libwpe for the benchmarks to drive the backend interfaces without a loader
+// or WebKit. View backends forward to their interface, EGL targets report frame completion
+// through a callback.
+
+#include <functional>
+#include <wpe/wpe-egl.h>
+
+namespace WPEStub {
+
+using FrameCompleteCallback = std::function<void()>;
+
+struct wpe_renderer_backend_egl_target* createTarget(FrameCompleteCallback&&);
+void destroyTarget(struct wpe_renderer_backend_egl_target*);
+
+} // namespace WPEStub
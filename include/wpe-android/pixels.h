@@ -0,0 +1,46 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef WPE_ANDROID_PIXELS_H
+#define WPE_ANDROID_PIXELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Conversions for CPU access to committed buffers. format is the AHardwareBuffer format of the
+// source, strides are in bytes. Functions return false if the format is not supported.
+// Swizzling and unpremultiplying can be done in place.
+
+bool WPEAndroidPixels_swizzleRGBAToBGRA(uint32_t format, const void* src, uint32_t srcStride,
+    void* dst, uint32_t dstStride, uint32_t width, uint32_t height);
+
+bool WPEAndroidPixels_unpremultiply(uint32_t format, const void* src, uint32_t srcStride,
+    void* dst, uint32_t dstStride, uint32_t width, uint32_t height);
+
+bool WPEAndroidPixels_boxDownscale(uint32_t format, const void* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcStride,
+    void* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstStride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WPE_ANDROID_PIXELS_H
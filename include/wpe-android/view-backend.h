@@ -23,6 +23,8 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <wpe/wpe.h>
 
 typedef struct AHardwareBuffer AHardwareBuffer;
@@ -43,12 +45,151 @@ WPEViewBackend* WPEAndroidViewBackend_getWPEViewBackend(WPEAndroidViewBackend*);
 typedef void (*WPEAndroidViewBackend_CommitBuffer)(void* context, WPEAndroidBuffer*, int fenceID);
 void WPEAndroidViewBackend_setCommitBufferHandler(WPEAndroidViewBackend*, void* context, WPEAndroidViewBackend_CommitBuffer func);
 
+typedef struct WPEAndroidCommit {
+    WPEAndroidViewBackend* viewBackend;
+    WPEAndroidBuffer* buffer;
+    // Owned by the handler, as with WPEAndroidViewBackend_CommitBuffer
+    int fenceFD;
+} WPEAndroidCommit;
+
+// With a batch handler set, the commits of every view are held instead of going to the commit
+// buffer handler of each view, and handed over together on WPEAndroid_latchCommits(), typically
+// called at the start of the consumer's frame, so that all views can be presented in a single
+// transaction. A view committing again before the latch replaces its previous commit, whose
+// buffer is released right away. A nullptr func goes back to the handlers of each view.
+typedef void (*WPEAndroid_CommitBatch)(void* context, const WPEAndroidCommit* commits, size_t count);
+void WPEAndroid_setCommitBatchHandler(void* context, WPEAndroid_CommitBatch func);
+void WPEAndroid_latchCommits(void);
+
 void WPEAndroidViewBackend_dispatchReleaseBuffer(WPEAndroidViewBackend*, WPEAndroidBuffer*);
 
+// Format and usage of the buffers the view is rendered into, as AHARDWAREBUFFER_FORMAT_* and
+// AHARDWAREBUFFER_USAGE_* values, 0 for the defaults: R8G8B8A8_UNORM, and COMPOSER_OVERLAY on top
+// of the GPU usage rendering needs. Opaque views, such as pages with an opaque background, get
+// R8G8B8X8_UNORM instead of R8G8B8A8_UNORM and their buffers are reported by
+// WPEAndroidBuffer_isOpaque(). Buffers are reallocated from the next frame on; when the device
+// cannot allocate them, the defaults are used instead.
+void WPEAndroidViewBackend_setBufferFormat(WPEAndroidViewBackend*, uint32_t format, uint64_t usage, bool opaque);
+
+// Sets the size of the view after WPEAndroidViewBackend_create(). Sizes set in quick succession,
+// such as during an animated layout change, are coalesced: the first one is dispatched right
+// away and the last one set within a frame interval of it is dispatched at the end of that
+// interval, so that the renderer reallocates its buffers once per interval at most.
+void WPEAndroidViewBackend_setSize(WPEAndroidViewBackend*, uint32_t width, uint32_t height);
+
+// Input for the view, in batches of the events received since the last call, dispatched to
+// WebKit in order. Moving touch points and pointer motion are held until the next frame
+// completion, or a frame interval at most, and only the latest touch motion event, which has
+// every touch point, and the latest pointer motion are dispatched. Other events are dispatched right away, after the motion held
+// before them. Events, and the touch points they point to, are copied.
+void WPEAndroidViewBackend_dispatchTouchEvents(WPEAndroidViewBackend*, const struct wpe_input_touch_event* events, size_t count);
+void WPEAndroidViewBackend_dispatchPointerEvents(WPEAndroidViewBackend*, const struct wpe_input_pointer_event* events, size_t count);
+void WPEAndroidViewBackend_dispatchKeyboardEvents(WPEAndroidViewBackend*, const struct wpe_input_keyboard_event* events, size_t count);
+
+// Views are visible when created. Hidden views, such as background tabs, lose the visible
+// activity state of their WPE view backend, complete frames about once per second whatever the
+// consumer does, and free the buffers the consumer does not hold. Buffers are allocated again
+// when the view is shown, ahead of its first frame.
+void WPEAndroidViewBackend_setVisible(WPEAndroidViewBackend*, bool visible);
+
 void WPEAndroidViewBackend_dispatchFrameComplete(WPEAndroidViewBackend*);
 
+// Same as WPEAndroidViewBackend_dispatchFrameComplete(), along with when the frame was presented
+// and the deadline of the next one, in CLOCK_MONOTONIC nanoseconds as Choreographer reports them,
+// or 0 when unknown. The WebProcess then starts its next frame just in time for that deadline
+// instead of right away.
+void WPEAndroidViewBackend_dispatchFrameCompleteWithTiming(WPEAndroidViewBackend*, int64_t presentationTime, int64_t nextDeadline);
+
+// Asynchronously reads back the last committed frame, downscaled by scale (0, 1], as RGBA8.
+// The callback runs on the calling thread's main context; pixels is nullptr on failure and
+// is only valid for the duration of the call.
+typedef void (*WPEAndroidViewBackend_Snapshot)(void* context, const void* pixels, uint32_t width, uint32_t height, uint32_t stride);
+void WPEAndroidViewBackend_requestSnapshot(WPEAndroidViewBackend*, float scale, void* context, WPEAndroidViewBackend_Snapshot func);
+
+#define WPE_ANDROID_LATENCY_HISTOGRAM_BUCKETS 20
+
+// Bucket i counts latencies in [2^i, 2^(i+1)) microseconds, the last one also everything longer
+typedef struct WPEAndroidLatencyHistogram {
+    uint64_t count;
+    uint64_t totalMicroseconds;
+    uint64_t buckets[WPE_ANDROID_LATENCY_HISTOGRAM_BUCKETS];
+} WPEAndroidLatencyHistogram;
+
+typedef struct WPEAndroidViewBackendStatistics {
+    uint64_t framesCommitted;
+    uint64_t framesReleased;
+    uint64_t frameCompletesSent;
+    // Input events dispatched to WebKit, and motion samples replaced by later ones before that
+    uint64_t inputEventsDispatched;
+    uint64_t inputEventsCoalesced;
+    uint64_t bufferAllocations;
+    uint64_t liveBufferBytes;
+    uint64_t pendingDeleteBuffers;
+    // Times the renderer had to wait for a buffer to be released, reported along with its commits
+    uint64_t starvationEvents;
+    uint64_t starvationMilliseconds;
+    WPEAndroidLatencyHistogram commitToRelease;
+    WPEAndroidLatencyHistogram commitToFrameComplete;
+    // Time messages to the WebProcesses rendering the view spent queued before reaching their
+    // socket: frame completions and releases, then pool management. Shared with other views
+    // rendered by the same WebProcesses.
+    WPEAndroidLatencyHistogram latencyLaneQueueing;
+    WPEAndroidLatencyHistogram bulkLaneQueueing;
+} WPEAndroidViewBackendStatistics;
+
+// Counters accumulated since the view backend was created, for the pools it currently owns
+void WPEAndroidViewBackend_getStatistics(WPEAndroidViewBackend*, WPEAndroidViewBackendStatistics*);
+
+// Logs the last IPC messages exchanged by every endpoint in the calling process, most recent
+// last. Safe to call from any thread, e.g. from a watchdog noticing a frozen view.
+void WPEAndroid_dumpIPCFlightRecorders(const char* reason);
+
+typedef enum {
+    WPE_ANDROID_EVENT_LOOP_GLIB,
+    WPE_ANDROID_EVENT_LOOP_LOOPER,
+    WPE_ANDROID_EVENT_LOOP_EPOLL,
+} WPEAndroidEventLoop;
+
+// Selects where the view backends and renderer host clients created afterwards on the calling
+// thread wait for IPC messages. GLIB, the default, uses the thread-default main context, LOOPER
+// the thread's ALooper so that UI threads need no GLib context. Returns false if the loop is not
+// available, e.g. LOOPER on a thread without a looper or outside Android.
+bool WPEAndroid_setEventLoop(WPEAndroidEventLoop);
+
+// With WPE_ANDROID_EVENT_LOOP_EPOLL, the file descriptor of the calling thread's loop becomes
+// readable whenever IPC messages are pending, WPEAndroid_dispatchEvents() then handles them
+int WPEAndroid_getEventLoopFd(void);
+void WPEAndroid_dispatchEvents(void);
+
+// Records the IPC traffic of view backends and renderers into path, for bench-ipc-replay.
+// Start it before creating any view, pools created earlier cannot be replayed.
+bool WPEAndroid_startIPCCapture(const char* path);
+void WPEAndroid_stopIPCCapture(void);
+
 AHardwareBuffer* WPEAndroidBuffer_getAHardwareBuffer(WPEAndroidBuffer*);
 
+// Shared memory buffers (WPE_ANDROID_SHARED_MEMORY_BUFFERS) have no AHardwareBuffer, their
+// RGBA pixels are directly accessible instead. These return nullptr/0 for hardware buffers.
+void* WPEAndroidBuffer_getData(WPEAndroidBuffer*);
+uint32_t WPEAndroidBuffer_getStride(WPEAndroidBuffer*);
+uint32_t WPEAndroidBuffer_getWidth(WPEAndroidBuffer*);
+uint32_t WPEAndroidBuffer_getHeight(WPEAndroidBuffer*);
+
+// AHARDWAREBUFFER_FORMAT_* of the buffer, and whether it can be presented without blending
+uint32_t WPEAndroidBuffer_getFormat(WPEAndroidBuffer*);
+bool WPEAndroidBuffer_isOpaque(WPEAndroidBuffer*);
+
+// A buffer is committed again and again until its pool is purged, by a resize or a format
+// change. Its ID, unlike its address, is never reused for another buffer of the process.
+uint64_t WPEAndroidBuffer_getID(WPEAndroidBuffer*);
+
+// Attaches data to the buffer under key, e.g. the texture or EGLImage the consumer imported it
+// as, so that it is imported only once. destroyNotify, if any, runs on the UI thread when the
+// data is replaced, unset with a nullptr data, or when the buffer is destroyed.
+typedef void (*WPEAndroidBuffer_DestroyNotify)(void* data);
+void WPEAndroidBuffer_setUserData(WPEAndroidBuffer*, const void* key, void* data, WPEAndroidBuffer_DestroyNotify destroyNotify);
+void* WPEAndroidBuffer_getUserData(WPEAndroidBuffer*, const void* key);
+
 #ifdef __cplusplus
 }
 #endif
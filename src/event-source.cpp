@@ -0,0 +1,442 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "event-source.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <map>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#if defined(__ANDROID__)
+#include <android/looper.h>
+#endif
+
+#include "logging.h"
+
+namespace IPC {
+
+static thread_local EventSource::Loop s_threadLoop = EventSource::Loop::GLib;
+
+class GLibEventSource final : public EventSource {
+public:
+    GLibEventSource(int fd, const char* name, Callback&& callback)
+        : EventSource(std::move(callback))
+        , m_fd(fd)
+        , m_context(g_main_context_get_thread_default())
+    {
+        m_source = g_unix_fd_source_new(fd, G_IO_IN);
+        g_source_set_name(m_source, name);
+        g_source_set_callback(m_source, reinterpret_cast<GSourceFunc>(fdCallback), this, nullptr);
+        g_source_attach(m_source, m_context);
+    }
+
+    ~GLibEventSource()
+    {
+        g_source_destroy(m_source);
+        g_source_unref(m_source);
+        if (m_outputSource) {
+            g_source_destroy(m_outputSource);
+            g_source_unref(m_outputSource);
+        }
+    }
+
+    void watchOutput(Callback&& output) override
+    {
+        m_output = std::move(output);
+        if (m_outputSource)
+            return;
+
+        m_outputSource = g_unix_fd_source_new(m_fd, G_IO_OUT);
+        g_source_set_callback(m_outputSource, reinterpret_cast<GSourceFunc>(outputCallback), this, nullptr);
+        g_source_attach(m_outputSource, m_context);
+    }
+
+private:
+    static gboolean fdCallback(gint, GIOCondition, gpointer data)
+    {
+        return static_cast<GLibEventSource*>(data)->dispatch() ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    }
+
+    static gboolean outputCallback(gint, GIOCondition, gpointer data)
+    {
+        auto& source = *static_cast<GLibEventSource*>(data);
+        if (source.dispatchOutput())
+            return G_SOURCE_CONTINUE;
+
+        g_source_unref(source.m_outputSource);
+        source.m_outputSource = nullptr;
+        return G_SOURCE_REMOVE;
+    }
+
+    int m_fd;
+    GMainContext* m_context;
+    GSource* m_source { nullptr };
+    GSource* m_outputSource { nullptr };
+};
+
+#if defined(__ANDROID__)
+class LooperEventSource final : public EventSource {
+public:
+    LooperEventSource(ALooper* looper, int fd, Callback&& callback)
+        : EventSource(std::move(callback))
+        , m_looper(looper)
+        , m_fd(fd)
+        , m_alive(std::make_shared<bool>(true))
+    {
+        ALooper_acquire(m_looper);
+        addFd(ALOOPER_EVENT_INPUT);
+    }
+
+    ~LooperEventSource()
+    {
+        *m_alive = false;
+        if (m_watching)
+            ALooper_removeFd(m_looper, m_fd);
+        ALooper_release(m_looper);
+    }
+
+    void watchOutput(Callback&& output) override
+    {
+        m_output = std::move(output);
+        if (m_watching && !m_watchingOutput) {
+            m_watchingOutput = true;
+            addFd(ALOOPER_EVENT_INPUT | ALOOPER_EVENT_OUTPUT);
+        }
+    }
+
+private:
+    // Adding the fd again replaces its previous registration
+    void addFd(int events)
+    {
+        ALooper_addFd(m_looper, m_fd, ALOOPER_POLL_CALLBACK, events, fdCallback, this);
+    }
+
+    static int fdCallback(int, int events, void* data)
+    {
+        auto& source = *static_cast<LooperEventSource*>(data);
+        auto alive = source.m_alive;
+
+        if (events & (ALOOPER_EVENT_INPUT | ALOOPER_EVENT_HANGUP | ALOOPER_EVENT_ERROR)) {
+            bool watching = source.dispatch();
+            if (!*alive)
+                return 1;
+            if (!watching) {
+                source.m_watching = false;
+                return 0;
+            }
+        }
+
+        if ((events & ALOOPER_EVENT_OUTPUT) && source.m_watchingOutput && !source.dispatchOutput()) {
+            source.m_watchingOutput = false;
+            source.addFd(ALOOPER_EVENT_INPUT);
+        }
+        return 1;
+    }
+
+    ALooper* m_looper;
+    int m_fd;
+    bool m_watching { true };
+    bool m_watchingOutput { false };
+    std::shared_ptr<bool> m_alive;
+};
+#endif
+
+class EpollEventSource;
+
+// Sources are looked up by ID rather than pointer, events still pending for a source destroyed
+// by an earlier callback of the same dispatch are dropped
+struct EpollLoop {
+    EpollLoop()
+    {
+        fd = epoll_create1(EPOLL_CLOEXEC);
+        if (fd == -1)
+            ALOGE("EventSource: cannot create epoll instance: %s", strerror(errno));
+    }
+
+    ~EpollLoop()
+    {
+        if (fd != -1)
+            close(fd);
+    }
+
+    int fd { -1 };
+    uint64_t nextID { 1 };
+    std::map<uint64_t, EpollEventSource*> sources;
+};
+
+static EpollLoop& epollLoop()
+{
+    static thread_local EpollLoop loop;
+    return loop;
+}
+
+class EpollEventSource final : public EventSource {
+public:
+    EpollEventSource(int fd, Callback&& callback)
+        : EventSource(std::move(callback))
+        , m_loop(epollLoop())
+        , m_fd(fd)
+        , m_id(m_loop.nextID++)
+    {
+        struct epoll_event event = { };
+        event.events = EPOLLIN;
+        event.data.u64 = m_id;
+        if (epoll_ctl(m_loop.fd, EPOLL_CTL_ADD, m_fd, &event) == -1) {
+            ALOGE("EventSource: cannot watch fd %d: %s", m_fd, strerror(errno));
+            return;
+        }
+
+        m_loop.sources[m_id] = this;
+    }
+
+    ~EpollEventSource()
+    {
+        stopWatching();
+    }
+
+    void watchOutput(Callback&& output) override
+    {
+        m_output = std::move(output);
+        if (!m_watchingOutput && m_loop.sources.count(m_id))
+            setEvents(EPOLLIN | EPOLLOUT);
+    }
+
+    static void dispatchEvents(EpollLoop& loop)
+    {
+        struct epoll_event events[16];
+        int count;
+        do {
+            count = epoll_wait(loop.fd, events, 16, 0);
+        } while (count == -1 && errno == EINTR);
+
+        for (int i = 0; i < count; ++i) {
+            uint64_t id = events[i].data.u64;
+            auto it = loop.sources.find(id);
+            if (it == loop.sources.end())
+                continue;
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                bool watching = it->second->dispatch();
+                it = loop.sources.find(id);
+                if (it == loop.sources.end())
+                    continue;
+                if (!watching) {
+                    it->second->stopWatching();
+                    continue;
+                }
+            }
+
+            auto& source = *it->second;
+            if ((events[i].events & EPOLLOUT) && source.m_watchingOutput && !source.dispatchOutput())
+                source.setEvents(EPOLLIN);
+        }
+    }
+
+private:
+    void setEvents(uint32_t events)
+    {
+        struct epoll_event event = { };
+        event.events = events;
+        event.data.u64 = m_id;
+        epoll_ctl(m_loop.fd, EPOLL_CTL_MOD, m_fd, &event);
+        m_watchingOutput = events & EPOLLOUT;
+    }
+
+    void stopWatching()
+    {
+        if (!m_loop.sources.erase(m_id))
+            return;
+
+        epoll_ctl(m_loop.fd, EPOLL_CTL_DEL, m_fd, nullptr);
+    }
+
+    EpollLoop& m_loop;
+    int m_fd;
+    uint64_t m_id;
+    bool m_watchingOutput { false };
+};
+
+std::unique_ptr<EventSource> EventSource::create(int fd, const char* name, Callback&& callback)
+{
+    switch (s_threadLoop) {
+    case Loop::GLib:
+        break;
+    case Loop::Looper:
+#if defined(__ANDROID__)
+        if (ALooper* looper = ALooper_forThread())
+            return std::unique_ptr<EventSource>(new LooperEventSource(looper, fd, std::move(callback)));
+#endif
+        break;
+    case Loop::Epoll:
+        return std::unique_ptr<EventSource>(new EpollEventSource(fd, std::move(callback)));
+    }
+
+    return std::unique_ptr<EventSource>(new GLibEventSource(fd, name, std::move(callback)));
+}
+
+bool EventSource::setThreadLoop(Loop loop)
+{
+    switch (loop) {
+    case Loop::GLib:
+        break;
+    case Loop::Looper:
+#if defined(__ANDROID__)
+        if (!ALooper_forThread())
+            return false;
+        break;
+#else
+        return false;
+#endif
+    case Loop::Epoll:
+        if (epollLoop().fd == -1)
+            return false;
+        break;
+    }
+
+    s_threadLoop = loop;
+    return true;
+}
+
+EventSource::Loop EventSource::threadLoop()
+{
+    return s_threadLoop;
+}
+
+int EventSource::epollFd()
+{
+    return epollLoop().fd;
+}
+
+void EventSource::dispatchEpollEvents()
+{
+    EpollEventSource::dispatchEvents(epollLoop());
+}
+
+DeferredCall::DeferredCall(const char* name, std::function<void()>&& function)
+    : m_function(std::move(function))
+{
+    m_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_fd == -1) {
+        ALOGE("DeferredCall: eventfd failed: %s", std::strerror(errno));
+        return;
+    }
+
+    m_source = EventSource::create(m_fd, name, [this] { return wakeUp(); });
+}
+
+DeferredCall::~DeferredCall()
+{
+    m_source = nullptr;
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+void DeferredCall::schedule()
+{
+    if (m_scheduled)
+        return;
+
+    // Without a loop to wake up, calling right away beats never calling
+    if (m_fd == -1) {
+        m_function();
+        return;
+    }
+
+    uint64_t value = 1;
+    if (write(m_fd, &value, sizeof(value)) == sizeof(value))
+        m_scheduled = true;
+}
+
+bool DeferredCall::wakeUp()
+{
+    uint64_t value;
+    while (read(m_fd, &value, sizeof(value)) == -1 && errno == EINTR) { }
+
+    m_scheduled = false;
+    m_function();
+    return true;
+}
+
+Timer::Timer(const char* name, std::function<void()>&& function)
+    : m_function(std::move(function))
+{
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (m_fd == -1) {
+        ALOGE("Timer: timerfd_create failed: %s", std::strerror(errno));
+        return;
+    }
+
+    m_source = EventSource::create(m_fd, name, [this] { return expired(); });
+}
+
+Timer::~Timer()
+{
+    m_source = nullptr;
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+void Timer::start(int64_t delay)
+{
+    // Without a loop to wake up, calling right away beats never calling
+    if (m_fd == -1) {
+        m_function();
+        return;
+    }
+
+    // A zero expiration would disarm the timer
+    delay = delay > 0 ? delay : 1;
+    struct itimerspec expiration = { };
+    expiration.it_value.tv_sec = delay / 1000000;
+    expiration.it_value.tv_nsec = (delay % 1000000) * 1000;
+    m_active = timerfd_settime(m_fd, 0, &expiration, nullptr) == 0;
+}
+
+void Timer::stop()
+{
+    if (m_fd == -1 || !m_active)
+        return;
+
+    struct itimerspec disarmed = { };
+    timerfd_settime(m_fd, 0, &disarmed, nullptr);
+    m_active = false;
+}
+
+bool Timer::expired()
+{
+    uint64_t expirations = 0;
+    ssize_t ret;
+    while ((ret = read(m_fd, &expirations, sizeof(expirations))) == -1 && errno == EINTR) { }
+
+    // Stopped or started again since it became readable
+    if (ret != sizeof(expirations) || !m_active)
+        return true;
+
+    m_active = false;
+    m_function();
+    return true;
+}
+
+} // namespace IPC
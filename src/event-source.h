@@ -0,0 +1,124 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Where IPC endpoints wait for incoming messages. Hosts and clients watch their socket on the
+// event loop selected for the thread initializing them: the thread-default GLib main context
+// unless told otherwise, the thread's ALooper on Android, or an epoll instance which the
+// application polls from whatever loop it runs.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace IPC {
+
+class EventSource {
+public:
+    enum class Loop {
+        GLib,
+        Looper,
+        Epoll,
+    };
+
+    // Called on the loop's thread whenever the file descriptor is readable or hung up. Returning
+    // false stops watching it; the callback may also destroy its event source.
+    using Callback = std::function<bool()>;
+
+    static std::unique_ptr<EventSource> create(int fd, const char* name, Callback&&);
+
+    virtual ~EventSource() = default;
+
+    // Also calls output whenever the file descriptor is writable, until it returns false
+    virtual void watchOutput(Callback&& output) = 0;
+
+    // Loop of the sources created afterwards on the calling thread, false if it is not available
+    static bool setThreadLoop(Loop);
+    static Loop threadLoop();
+
+    // Epoll loop of the calling thread, its file descriptor becomes readable when events are pending
+    static int epollFd();
+    static void dispatchEpollEvents();
+
+protected:
+    EventSource(Callback&& callback)
+        : m_callback(std::move(callback))
+    { }
+
+    // The callback may destroy the source, so it runs from a copy
+    bool dispatch() const
+    {
+        Callback callback = m_callback;
+        return callback();
+    }
+
+    bool dispatchOutput()
+    {
+        if (m_output && m_output())
+            return true;
+
+        m_output = nullptr;
+        return false;
+    }
+
+    Callback m_output;
+
+private:
+    Callback m_callback;
+};
+
+// Calls a function once from the loop of the thread creating it, after whatever is being
+// dispatched returns, however many times it was scheduled meanwhile
+class DeferredCall {
+public:
+    DeferredCall(const char* name, std::function<void()>&&);
+    ~DeferredCall();
+
+    void schedule();
+
+private:
+    bool wakeUp();
+
+    int m_fd { -1 };
+    bool m_scheduled { false };
+    std::unique_ptr<EventSource> m_source;
+    std::function<void()> m_function;
+};
+
+// Calls a function from the loop of the thread creating it once a delay in microseconds has
+// passed. Starting it again moves the expiration.
+class Timer {
+public:
+    Timer(const char* name, std::function<void()>&&);
+    ~Timer();
+
+    void start(int64_t delay);
+    void stop();
+    bool isActive() const { return m_active; }
+
+private:
+    bool expired();
+
+    int m_fd { -1 };
+    bool m_active { false };
+    std::unique_ptr<EventSource> m_source;
+    std::function<void()> m_function;
+};
+
+} // namespace IPC
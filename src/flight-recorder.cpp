@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "flight-recorder.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <gio/gio.h>
+#include <mutex>
+#include <vector>
+
+#include "logging.h"
+
+namespace IPC {
+
+static std::mutex s_recordersMutex;
+
+static std::vector<FlightRecorder*>& recorders()
+{
+    static std::vector<FlightRecorder*> s_recorders;
+    return s_recorders;
+}
+
+static const char* directionName(FlightRecorder::Direction direction)
+{
+    switch (direction) {
+    case FlightRecorder::Direction::Sent:
+        return "sent";
+    case FlightRecorder::Direction::Received:
+        return "received";
+    case FlightRecorder::Direction::SentFileDescriptor:
+        return "sent fd";
+    case FlightRecorder::Direction::ReceivedFileDescriptor:
+        return "received fd";
+    }
+    return "";
+}
+
+void FlightRecorder::initialize(const char* role, int socketFd)
+{
+    m_role = role;
+    m_socketFd = socketFd;
+
+    std::lock_guard<std::mutex> lock(s_recordersMutex);
+    recorders().push_back(this);
+}
+
+void FlightRecorder::deinitialize()
+{
+    std::lock_guard<std::mutex> lock(s_recordersMutex);
+    auto& list = recorders();
+    list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+void FlightRecorder::recordMessage(Direction direction, const char* data, size_t size)
+{
+    Record record { g_get_monotonic_time(), 0, 0, 0, -1, direction };
+
+    uint64_t messageCode = 0;
+    uint32_t ids[2] = { 0, 0 };
+    if (size >= sizeof(messageCode) + sizeof(ids)) {
+        std::memcpy(&messageCode, data, sizeof(messageCode));
+        std::memcpy(ids, data + sizeof(messageCode), sizeof(ids));
+    }
+
+    record.messageCode = uint32_t(messageCode);
+    record.poolID = ids[0];
+    record.bufferID = ids[1];
+    FlightRecorder::record(record);
+}
+
+void FlightRecorder::recordFileDescriptor(Direction direction, int fd)
+{
+    record({ g_get_monotonic_time(), 0, 0, 0, fd, direction });
+}
+
+void FlightRecorder::record(const Record& record)
+{
+    uint64_t index = m_next.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = m_slots[index % capacity];
+
+    // Seqlock-style publication, a concurrent dump skips the slot rather than print a torn record
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void FlightRecorder::dump(const char* reason) const
+{
+    uint64_t next = m_next.load(std::memory_order_acquire);
+    uint64_t first = next > capacity ? next - capacity : 0;
+    int64_t now = g_get_monotonic_time();
+
+    ALOGW("IPC flight recorder, %s fd %d: %s, last %u of %" PRIu64 " events",
+        m_role, m_socketFd, reason, unsigned(next - first), next);
+
+    for (uint64_t index = first; index < next; ++index) {
+        auto& slot = m_slots[index % capacity];
+
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != index + 1 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        ALOGW("  %8" PRId64 "us %-11s code %2u pool %u buffer %u fd %d",
+            record.timestamp - now, directionName(record.direction),
+            record.messageCode, record.poolID, record.bufferID, record.fd);
+    }
+}
+
+void FlightRecorder::dumpAll(const char* reason)
+{
+    std::lock_guard<std::mutex> lock(s_recordersMutex);
+    for (auto* recorder : recorders())
+        recorder->dump(reason);
+}
+
+void FlightRecorder::dumpAllOnAnomaly(const char* reason)
+{
+    static const int64_t interval = 5 * G_USEC_PER_SEC;
+    static std::atomic<int64_t> s_lastDump { 0 };
+
+    int64_t now = g_get_monotonic_time();
+    int64_t lastDump = s_lastDump.load(std::memory_order_relaxed);
+    if (lastDump && now - lastDump < interval)
+        return;
+    if (!s_lastDump.compare_exchange_strong(lastDump, now, std::memory_order_relaxed))
+        return;
+
+    dumpAll(reason);
+}
+
+} // namespace IPC
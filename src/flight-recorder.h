@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// A fixed-size ring of the last IPC events seen by one endpoint, always on. Recording is a
+// timestamp, an atomic increment and a few stores, so it stays off the profiles; the ring is
+// only ever read back when something went wrong, to log what led up to it.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace IPC {
+
+class FlightRecorder {
+public:
+    enum class Direction : uint8_t {
+        Sent,
+        Received,
+        SentFileDescriptor,
+        ReceivedFileDescriptor,
+    };
+
+    struct Record {
+        int64_t timestamp;
+        uint32_t messageCode;
+        // First two words of the payload, the pool and buffer IDs of every message carrying them
+        uint32_t poolID;
+        uint32_t bufferID;
+        int32_t fd;
+        Direction direction;
+    };
+
+    static const size_t capacity = 128;
+
+    void initialize(const char* role, int socketFd);
+    void deinitialize();
+
+    void recordMessage(Direction, const char* data, size_t size);
+    void recordFileDescriptor(Direction, int fd);
+
+    void dump(const char* reason) const;
+
+    // Dump the recorders of every IPC endpoint alive in this process
+    static void dumpAll(const char* reason);
+    // Same, but for anomalies that may repeat: at most one dump every few seconds
+    static void dumpAllOnAnomaly(const char* reason);
+
+private:
+    void record(const Record&);
+
+    struct Slot {
+        // Index + 1 of the record held, 0 while it is being written
+        std::atomic<uint64_t> sequence { 0 };
+        Record record;
+    };
+
+    std::array<Slot, capacity> m_slots;
+    std::atomic<uint64_t> m_next { 0 };
+
+    const char* m_role { "" };
+    int m_socketFd { -1 };
+};
+
+} // namespace IPC
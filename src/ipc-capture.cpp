@@ -0,0 +1,158 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ipc-capture.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "ipc-messages.h"
+#include "logging.h"
+
+namespace IPC {
+
+namespace Capture {
+
+std::atomic<bool> s_active { false };
+
+static std::atomic<uint32_t> s_nextEndpoint { 1 };
+
+// Hosts live on the UI thread, but nothing prevents an application from having several
+static std::mutex s_mutex;
+static FILE* s_file { nullptr };
+static int64_t s_startTime { 0 };
+
+static void write(RecordType type, uint32_t endpoint, const Message& message)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_file)
+        return;
+
+    Record record;
+    std::memset(record.padding, 0, sizeof(record.padding));
+    record.timestamp = g_get_monotonic_time() - s_startTime;
+    record.endpoint = endpoint;
+    record.type = type;
+    record.message = message;
+
+    if (std::fwrite(&record, sizeof(record), 1, s_file) != 1) {
+        ALOGW("IPC capture: write failed, stopping: %s", std::strerror(errno));
+        s_active.store(false, std::memory_order_relaxed);
+        std::fclose(s_file);
+        s_file = nullptr;
+    }
+}
+
+bool start(const char* path)
+{
+    stop();
+
+    FILE* file = std::fopen(path, "wbe");
+    if (!file) {
+        ALOGW("IPC capture: cannot open %s: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version = s_version;
+    header.recordSize = sizeof(Record);
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        ALOGW("IPC capture: cannot write %s: %s", path, std::strerror(errno));
+        std::fclose(file);
+        return false;
+    }
+
+    ALOGD("IPC capture: started into %s", path);
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_file = file;
+    s_startTime = g_get_monotonic_time();
+    s_active.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void stop()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_active.store(false, std::memory_order_relaxed);
+    if (s_file) {
+        std::fclose(s_file);
+        s_file = nullptr;
+    }
+}
+
+static void startFromEnvironment()
+{
+    static std::once_flag s_once;
+    std::call_once(s_once, [] {
+        const char* path = std::getenv("WPE_ANDROID_IPC_CAPTURE_FILE");
+        if (path && *path)
+            start(path);
+    });
+}
+
+uint32_t openEndpoint()
+{
+    // Only the UI process has hosts, the first one is created before any message is exchanged
+    startFromEnvironment();
+
+    uint32_t endpoint = s_nextEndpoint.fetch_add(1, std::memory_order_relaxed);
+    if (isActive())
+        write(RecordType::EndpointOpened, endpoint, Message());
+    return endpoint;
+}
+
+void closeEndpoint(uint32_t endpoint)
+{
+    if (isActive())
+        write(RecordType::EndpointClosed, endpoint, Message());
+}
+
+void record(RecordType type, uint32_t endpoint, const char* data, size_t size)
+{
+    if (size != Message::size)
+        return;
+
+    Message message;
+    std::memcpy(&message, data, Message::size);
+    write(type, endpoint, message);
+}
+
+void recordBufferDescription(uint32_t endpoint, uint32_t poolID, uint32_t bufferID, const AHardwareBuffer_Desc& description)
+{
+    SharedMemoryBufferAllocation allocation;
+    allocation.poolID = poolID;
+    allocation.bufferID = bufferID;
+    allocation.width = description.width;
+    allocation.height = description.height;
+    allocation.stride = description.stride;
+    allocation.format = description.format;
+
+    Message message;
+    SharedMemoryBufferAllocation::construct(message, allocation);
+    message.messageCode = BufferAllocation::code;
+    write(RecordType::BufferDescription, endpoint, message);
+}
+
+} // namespace Capture
+
+} // namespace IPC
@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Capture of the IPC traffic of the UI process into a file that bench-ipc-replay plays back on
+// desktop Linux. Every message going through an IPC::Host is recorded along with the description
+// of the hardware buffers received, whose content is not kept, and so is the ViewIdentity handed
+// to the renderer targets of each view. Nothing is recorded unless a
+// capture was started, through WPEAndroid_startIPCCapture() or WPE_ANDROID_IPC_CAPTURE_FILE.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "ipc.h"
+#include "platform.h"
+
+namespace IPC {
+
+namespace Capture {
+
+// The file is a FileHeader followed by fixed-size Records in the host's byte order
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+static const char s_magic[8] = { 'W', 'P', 'E', 'I', 'P', 'C', 'A', 'P' };
+static const uint32_t s_version = 3;
+
+enum class RecordType : uint8_t {
+    EndpointOpened,
+    EndpointClosed,
+    // Messages received from or sent to the client side of the endpoint
+    Received,
+    Sent,
+    // Follows the BufferAllocation message of a hardware buffer, as a SharedMemoryBufferAllocation
+    // payload with the stride in pixels
+    BufferDescription,
+};
+
+struct Record {
+    // Microseconds since the capture started
+    int64_t timestamp;
+    // Identifies the IPC::Host or the view in the process, every one gets an ID even while not
+    // capturing
+    uint32_t endpoint;
+    RecordType type;
+    uint8_t padding[3];
+    Message message;
+};
+static_assert(sizeof(Record) == 48, "Record is of correct size");
+
+extern std::atomic<bool> s_active;
+
+inline bool isActive()
+{
+    return s_active.load(std::memory_order_relaxed);
+}
+
+// Starts a new capture into path, replacing any capture in progress
+bool start(const char* path);
+void stop();
+
+// The first call also starts a capture into WPE_ANDROID_IPC_CAPTURE_FILE if it is set
+
+uint32_t openEndpoint();
+void closeEndpoint(uint32_t endpoint);
+
+void record(RecordType, uint32_t endpoint, const char* data, size_t size);
+void recordBufferDescription(uint32_t endpoint, uint32_t poolID, uint32_t bufferID, const AHardwareBuffer_Desc&);
+
+} // namespace Capture
+
+} // namespace IPC
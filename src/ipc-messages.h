@@ -20,8 +20,33 @@
 
 namespace IPC {
 
+// Version of the messages below, bumped whenever their layout or meaning changes. Peers of other
+// versions cannot be understood at all and are disconnected, see Handshake. Anything optional on
+// top of the messages is a capability, used only once both sides of a connection announced it in
+// the handshake.
+static const uint32_t protocolVersion = 2;
+
+enum Capability : uint32_t {
+    // FrameFeedback carries the presentation time and next deadline of completed frames
+    CapabilityFrameTiming = 1 << 0,
+    // Pools are allocated with the format, usage and opacity of their view, see PoolFormat
+    CapabilityBufferFormats = 1 << 1,
+    // Hidden views throttle frame completion and park their idle buffers, see PoolVisibility
+    CapabilityVisibility = 1 << 2,
+    // Renderers may read their frames back into shared memory, see SharedMemoryBufferAllocation
+    CapabilitySharedMemoryBuffers = 1 << 3,
+    // Commits may be followed by a native fence signaling the end of rendering, see BufferCommit.
+    // Renderers without it finish rendering before committing.
+    CapabilityCommitFences = 1 << 4,
+};
+
+static const uint32_t supportedCapabilities = CapabilityFrameTiming | CapabilityBufferFormats | CapabilityVisibility
+    | CapabilitySharedMemoryBuffers | CapabilityCommitFences;
+
 struct PoolConstruction {
-    uint8_t padding[24];
+    // View the pool belongs to, as received in ViewIdentity
+    uint32_t viewID;
+    uint8_t padding[20];
 
     static const uint64_t code = 4;
     static void construct(Message& message, const PoolConstruction& data)
@@ -41,7 +66,13 @@ static_assert(sizeof(PoolConstruction) == Message::dataSize, "PoolConstruction i
 
 struct PoolConstructionReply {
     uint32_t poolID;
-    uint8_t padding[20];
+    // With CapabilityBufferFormats, as in PoolFormat
+    uint32_t format;
+    uint64_t usage;
+    uint8_t opaque;
+    // With CapabilityVisibility, the view is hidden as in PoolVisibility
+    uint8_t hidden;
+    uint8_t padding[6];
 
     static const uint64_t code = 5;
     static void construct(Message& message, const PoolConstructionReply& data)
@@ -79,71 +110,88 @@ struct PoolPurge {
 };
 static_assert(sizeof(PoolPurge) == Message::dataSize, "PoolPurge is of correct size");
 
-struct RegisterPool {
+struct UnregisterPool {
     uint32_t poolID;
     uint8_t padding[20];
 
-    static const uint64_t code = 7;
-    static void construct(Message& message, const RegisterPool& data)
+    static const uint64_t code = 8;
+    static void construct(Message& message, const UnregisterPool& data)
     {
         message.messageCode = code;
         std::memcpy(&message.messageData, &data, Message::dataSize);
     }
 
-    static RegisterPool from(const Message& message)
+    static UnregisterPool from(const Message& message)
     {
-        RegisterPool data;
+        UnregisterPool data;
         std::memcpy(&data, &message.messageData, Message::dataSize);
         return data;
     }
 };
-static_assert(sizeof(RegisterPool) == Message::dataSize, "RegisterPool is of correct size");
+static_assert(sizeof(UnregisterPool) == Message::dataSize, "UnregisterPool is of correct size");
 
-struct UnregisterPool {
+// Followed by the AHardwareBuffer
+struct BufferAllocation {
     uint32_t poolID;
-    uint8_t padding[20];
+    uint32_t bufferID;
+    // With CapabilityBufferFormats, whether the content has no transparency whatever the format
+    uint8_t opaque;
+    uint8_t padding[15];
 
-    static const uint64_t code = 8;
-    static void construct(Message& message, const UnregisterPool& data)
+    static const uint64_t code = 10;
+    static void construct(Message& message, const BufferAllocation& data)
     {
         message.messageCode = code;
         std::memcpy(&message.messageData, &data, Message::dataSize);
     }
 
-    static UnregisterPool from(const Message& message)
+    static BufferAllocation from(const Message& message)
     {
-        UnregisterPool data;
+        BufferAllocation data;
         std::memcpy(&data, &message.messageData, Message::dataSize);
         return data;
     }
 };
-static_assert(sizeof(UnregisterPool) == Message::dataSize, "UnregisterPool is of correct size");
+static_assert(sizeof(BufferAllocation) == Message::dataSize, "BufferAllocation is of correct size");
 
-struct BufferAllocation {
+// Followed by the file descriptor of the memfd holding stride * height bytes of pixel data
+struct SharedMemoryBufferAllocation {
     uint32_t poolID;
     uint32_t bufferID;
-    uint8_t padding[16];
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
 
-    static const uint64_t code = 10;
-    static void construct(Message& message, const BufferAllocation& data)
+    static const uint64_t code = 11;
+    static void construct(Message& message, const SharedMemoryBufferAllocation& data)
     {
         message.messageCode = code;
         std::memcpy(&message.messageData, &data, Message::dataSize);
     }
 
-    static BufferAllocation from(const Message& message)
+    static SharedMemoryBufferAllocation from(const Message& message)
     {
-        BufferAllocation data;
+        SharedMemoryBufferAllocation data;
         std::memcpy(&data, &message.messageData, Message::dataSize);
         return data;
     }
 };
-static_assert(sizeof(BufferAllocation) == Message::dataSize, "BufferAllocation is of correct size");
+static_assert(sizeof(SharedMemoryBufferAllocation) == Message::dataSize, "SharedMemoryBufferAllocation is of correct size");
 
 struct BufferCommit {
     uint32_t poolID;
     uint32_t bufferID;
-    uint8_t padding[16];
+    // Counts commits per pool, identifies the frame in traces of both processes
+    uint32_t frameID;
+    // Renderer statistics, totals since the pool was created
+    uint32_t starvationEvents;
+    uint32_t starvationMilliseconds;
+    // A fence file descriptor follows the message, needs CapabilityCommitFences. Shared memory
+    // buffers are read back synchronously and never have one, neither do frames of renderers
+    // without native fences.
+    uint8_t hasFence;
+    uint8_t padding[3];
 
     static const uint64_t code = 15;
     static void construct(Message& message, const BufferCommit& data)
@@ -161,45 +209,202 @@ struct BufferCommit {
 };
 static_assert(sizeof(BufferCommit) == Message::dataSize, "BufferCommit is of correct size");
 
-struct ReleaseBuffer {
+// Only message of the socket handed to each renderer target through libwpe, everything else
+// goes through the connection of the WebProcess
+struct ViewIdentity {
+    uint32_t viewID;
+    uint8_t padding[20];
+
+    static const uint64_t code = 24;
+    static void construct(Message& message, const ViewIdentity& data)
+    {
+        message.messageCode = code;
+        std::memcpy(&message.messageData, &data, Message::dataSize);
+    }
+
+    static ViewIdentity from(const Message& message)
+    {
+        ViewIdentity data;
+        std::memcpy(&data, &message.messageData, Message::dataSize);
+        return data;
+    }
+};
+static_assert(sizeof(ViewIdentity) == Message::dataSize, "ViewIdentity is of correct size");
+
+// Everything the renderer learns about a pool after the UI process presented a frame, gathered
+// during one iteration of the UI loop
+struct FrameFeedback {
     uint32_t poolID;
-    uint32_t bufferID;
+    // frameID of the last commit seen by the UI process, when frameComplete is set
+    uint32_t frameID;
+    // Bit i set when bufferID i was released
+    uint8_t releasedBuffers;
+    uint8_t frameComplete;
+    uint8_t padding[2];
+    // With frameComplete, microseconds from presentationTime to the deadline of the next frame,
+    // 0 if unknown
+    uint32_t nextDeadlineOffset;
+    // With frameComplete, when the frame was presented in CLOCK_MONOTONIC microseconds, 0 if unknown
+    int64_t presentationTime;
+
+    static const uint64_t code = 25;
+    static void construct(Message& message, const FrameFeedback& data)
+    {
+        message.messageCode = code;
+        std::memcpy(&message.messageData, &data, Message::dataSize);
+    }
+
+    static FrameFeedback from(const Message& message)
+    {
+        FrameFeedback data;
+        std::memcpy(&data, &message.messageData, Message::dataSize);
+        return data;
+    }
+
+    // Folds message into queued when both are feedback for the same pool, see Host::sendMessage()
+    static bool merge(Message& queued, const Message& message)
+    {
+        if (queued.messageCode != code || message.messageCode != code)
+            return false;
+
+        auto merged = from(queued);
+        auto feedback = from(message);
+        if (merged.poolID != feedback.poolID)
+            return false;
+
+        merged.releasedBuffers |= feedback.releasedBuffers;
+        if (feedback.frameComplete) {
+            merged.frameComplete = 1;
+            merged.frameID = feedback.frameID;
+            merged.nextDeadlineOffset = feedback.nextDeadlineOffset;
+            merged.presentationTime = feedback.presentationTime;
+        }
+        construct(queued, merged);
+        return true;
+    }
+};
+static_assert(sizeof(FrameFeedback) == Message::dataSize, "FrameFeedback is of correct size");
+
+// First message of the WebProcess on its connection. The UI process replies with its own version
+// in any case, and closes the connection unless both versions are the same. Connections not
+// starting with a handshake are closed too.
+struct Handshake {
+    uint32_t protocolVersion;
+    uint32_t capabilities;
     uint8_t padding[16];
 
-    static const uint64_t code = 16;
-    static void construct(Message& message, const ReleaseBuffer& data)
+    static const uint64_t code = 26;
+    static void construct(Message& message, const Handshake& data)
     {
         message.messageCode = code;
         std::memcpy(&message.messageData, &data, Message::dataSize);
     }
 
-    static ReleaseBuffer from(const Message& message)
+    static Handshake from(const Message& message)
     {
-        ReleaseBuffer data;
+        Handshake data;
         std::memcpy(&data, &message.messageData, Message::dataSize);
         return data;
     }
 };
-static_assert(sizeof(ReleaseBuffer) == Message::dataSize, "ReleaseBuffer is of correct size");
+static_assert(sizeof(Handshake) == Message::dataSize, "Handshake is of correct size");
+
+// Sent before anything else to the WebProcess, capabilities being the ones both sides support
+struct HandshakeReply {
+    uint32_t protocolVersion;
+    uint32_t capabilities;
+    uint8_t padding[16];
 
-struct FrameComplete {
+    static const uint64_t code = 27;
+    static void construct(Message& message, const HandshakeReply& data)
+    {
+        message.messageCode = code;
+        std::memcpy(&message.messageData, &data, Message::dataSize);
+    }
+
+    static HandshakeReply from(const Message& message)
+    {
+        HandshakeReply data;
+        std::memcpy(&data, &message.messageData, Message::dataSize);
+        return data;
+    }
+};
+static_assert(sizeof(HandshakeReply) == Message::dataSize, "HandshakeReply is of correct size");
+
+// Buffers the view wants its pools to be allocated as, the renderer drops the ones it has when
+// they differ. Needs CapabilityBufferFormats.
+struct PoolFormat {
     uint32_t poolID;
-    uint8_t padding[20];
+    // AHARDWAREBUFFER_FORMAT_*, 0 for R8G8B8A8_UNORM
+    uint32_t format;
+    // AHARDWAREBUFFER_USAGE_* besides what rendering needs, 0 for COMPOSER_OVERLAY
+    uint64_t usage;
+    // The content has no transparency, R8G8B8A8_UNORM then becomes R8G8B8X8_UNORM
+    uint8_t opaque;
+    uint8_t padding[7];
+
+    static const uint64_t code = 28;
+    static void construct(Message& message, const PoolFormat& data)
+    {
+        message.messageCode = code;
+        std::memcpy(&message.messageData, &data, Message::dataSize);
+    }
+
+    static PoolFormat from(const Message& message)
+    {
+        PoolFormat data;
+        std::memcpy(&data, &message.messageData, Message::dataSize);
+        return data;
+    }
+};
+static_assert(sizeof(PoolFormat) == Message::dataSize, "PoolFormat is of correct size");
+
+// The view of the pool was shown or hidden. Hidden pools complete frames at a low rate and park
+// the buffers they are not rendering into, which are allocated again once shown. Needs
+// CapabilityVisibility.
+struct PoolVisibility {
+    uint32_t poolID;
+    uint8_t visible;
+    uint8_t padding[19];
+
+    static const uint64_t code = 29;
+    static void construct(Message& message, const PoolVisibility& data)
+    {
+        message.messageCode = code;
+        std::memcpy(&message.messageData, &data, Message::dataSize);
+    }
+
+    static PoolVisibility from(const Message& message)
+    {
+        PoolVisibility data;
+        std::memcpy(&data, &message.messageData, Message::dataSize);
+        return data;
+    }
+};
+static_assert(sizeof(PoolVisibility) == Message::dataSize, "PoolVisibility is of correct size");
+
+// Buffers of the pool the renderer freed while its view is hidden, the UI process drops its
+// references to them as well. Needs CapabilityVisibility.
+struct PoolPark {
+    uint32_t poolID;
+    // Bit N set for the buffer with bufferID N
+    uint32_t parkedBuffers;
+    uint8_t padding[16];
 
-    static const uint64_t code = 23;
-    static void construct(Message& message, const FrameComplete& data)
+    static const uint64_t code = 30;
+    static void construct(Message& message, const PoolPark& data)
     {
         message.messageCode = code;
         std::memcpy(&message.messageData, &data, Message::dataSize);
     }
 
-    static FrameComplete from(const Message& message)
+    static PoolPark from(const Message& message)
     {
-        FrameComplete data;
+        PoolPark data;
         std::memcpy(&data, &message.messageData, Message::dataSize);
         return data;
     }
 };
-static_assert(sizeof(FrameComplete) == Message::dataSize, "FrameComplete is of correct size");
+static_assert(sizeof(PoolPark) == Message::dataSize, "PoolPark is of correct size");
 
 }
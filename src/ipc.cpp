@@ -18,15 +18,61 @@
 
 #include "ipc.h"
 
+#include <iterator>
 #include <cstdio>
+#include <cstring>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "ipc-capture.h"
+#include "ipc-messages.h"
 #include "logging.h"
+#include "trace.h"
 
 namespace IPC {
 
+Lane laneOf(const Message& message)
+{
+    switch (message.messageCode) {
+    case FrameFeedback::code:
+    // Frame completion that follows must not find the pool still hidden
+    case PoolVisibility::code:
+        return Lane::Latency;
+    default:
+        return Lane::Bulk;
+    }
+}
+
+static bool poolOf(const Message& message, uint32_t& poolID)
+{
+    switch (message.messageCode) {
+    case PoolConstructionReply::code:
+    case PoolPurge::code:
+    case UnregisterPool::code:
+    case BufferAllocation::code:
+    case SharedMemoryBufferAllocation::code:
+    case BufferCommit::code:
+    case FrameFeedback::code:
+    case PoolFormat::code:
+    case PoolVisibility::code:
+    case PoolPark::code:
+        // All of them start with the poolID
+        std::memcpy(&poolID, &message.messageData, sizeof(poolID));
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool mustPrecede(const Message& earlier, const Message& later)
+{
+    uint32_t earlierPoolID, laterPoolID;
+    if (!poolOf(earlier, earlierPoolID) || !poolOf(later, laterPoolID))
+        return true;
+    return earlierPoolID == laterPoolID;
+}
+
 Host::Host() = default;
 
 void Host::initialize(Handler& handler)
@@ -45,11 +91,11 @@ void Host::initialize(Handler& handler)
         return;
     }
 
-    m_source = g_socket_create_source(m_socket, G_IO_IN, nullptr);
-    g_source_set_callback(m_source, reinterpret_cast<GSourceFunc>(socketCallback), this, nullptr);
-    g_source_attach(m_source, g_main_context_get_thread_default());
+    m_source = EventSource::create(sockets[0], "WPEBackend-android::host", [this] { return socketCallback(); });
 
     m_clientFd = sockets[1];
+    m_flightRecorder.initialize("host", sockets[0]);
+    m_captureEndpoint = Capture::openEndpoint();
 }
 
 void Host::deinitialize()
@@ -57,13 +103,17 @@ void Host::deinitialize()
     if (m_clientFd != -1)
         close(m_clientFd);
 
-    if (m_source) {
-        g_source_destroy(m_source);
-        g_source_unref(m_source);
-    }
+    m_source = nullptr;
+    for (auto& queue : m_sendQueues)
+        queue.clear();
+    m_clientUnresponsive = false;
+    m_receivedOffset = 0;
 
-    if (m_socket)
+    if (m_socket) {
+        m_flightRecorder.deinitialize();
+        Capture::closeEndpoint(m_captureEndpoint);
         g_clear_object(&m_socket);
+    }
 
     m_handler = nullptr;
 }
@@ -75,6 +125,15 @@ int Host::socketFd()
     return -1;
 }
 
+void Host::shutdown()
+{
+    if (!m_socket)
+        return;
+
+    ALOGE("IPC::Host: shutting down the connection of fd %d", socketFd());
+    ::shutdown(socketFd(), SHUT_RDWR);
+}
+
 int Host::releaseClientFD(bool closeSourceFd)
 {
     int fd = dup(m_clientFd);
@@ -85,9 +144,122 @@ int Host::releaseClientFD(bool closeSourceFd)
     return fd;
 }
 
-void Host::sendMessage(char* data, size_t size)
+void Host::sendMessage(char* data, size_t size, MergeFunction merge)
 {
-    g_socket_send(m_socket, data, size, nullptr, nullptr);
+    if (!m_socket || size != Message::size)
+        return;
+
+    m_flightRecorder.recordMessage(FlightRecorder::Direction::Sent, data, size);
+    if (Capture::isActive())
+        Capture::record(Capture::RecordType::Sent, m_captureEndpoint, data, size);
+
+    QueuedMessage queued = { Message::cast(data), 0, g_get_monotonic_time() };
+    Lane lane = laneOf(queued.message);
+    if (lane == Lane::Latency) {
+        // Waits behind bulk messages it may not overtake
+        for (auto& earlier : m_sendQueues[size_t(Lane::Bulk)]) {
+            if (mustPrecede(earlier.message, queued.message)) {
+                lane = Lane::Bulk;
+                break;
+            }
+        }
+    }
+    auto& queue = m_sendQueues[size_t(lane)];
+
+    if (merge) {
+        // The front message may be partially written already and must stay as it is. Merging into
+        // a message queued before one this may not overtake would reorder them.
+        for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+            if (!it->offset && merge(it->message, queued.message))
+                return;
+            if (mustPrecede(it->message, queued.message))
+                break;
+        }
+    }
+
+    size_t queuedCount = queuedMessages();
+    if (!queuedCount) {
+        if (!write(queued))
+            return;
+        if (queued.offset == Message::size) {
+            m_queueingDelay[size_t(lane)].add(0);
+            return;
+        }
+    }
+
+    queue.push_back(queued);
+    if (!queuedCount)
+        m_source->watchOutput([this] { return flushSendQueues(); });
+    WPEAndroid::Trace::counter(lane == Lane::Latency ? "IPC latency lane queued" : "IPC bulk lane queued", queue.size());
+
+    if (!m_clientUnresponsive && queuedCount + 1 >= sendQueueHighWaterMark) {
+        ALOGW("IPC::Host: client of fd %d is not reading its messages, %zu are queued", socketFd(), queuedCount + 1);
+        m_clientUnresponsive = true;
+        m_handler->clientBecameUnresponsive();
+    }
+}
+
+bool Host::write(QueuedMessage& queued)
+{
+    while (queued.offset < Message::size) {
+        GError* error = nullptr;
+        gssize len = g_socket_send_with_blocking(m_socket, Message::data(queued.message) + queued.offset,
+            Message::size - queued.offset, FALSE, nullptr, &error);
+        if (len < 0) {
+            bool wouldBlock = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+            g_error_free(error);
+            return wouldBlock;
+        }
+        queued.offset += len;
+    }
+    return true;
+}
+
+size_t Host::queuedMessages() const
+{
+    size_t count = 0;
+    for (auto& queue : m_sendQueues)
+        count += queue.size();
+    return count;
+}
+
+Host::SendQueue* Host::nextSendQueue()
+{
+    for (auto& queue : m_sendQueues) {
+        if (!queue.empty() && queue.front().offset)
+            return &queue;
+    }
+    for (auto& queue : m_sendQueues) {
+        if (!queue.empty())
+            return &queue;
+    }
+    return nullptr;
+}
+
+bool Host::flushSendQueues()
+{
+    while (auto* queue = nextSendQueue()) {
+        auto& queued = queue->front();
+        if (!write(queued)) {
+            // The client is gone, nobody will read these
+            for (auto& queue : m_sendQueues)
+                queue.clear();
+            break;
+        }
+        if (queued.offset < Message::size)
+            return true;
+
+        size_t lane = std::distance(m_sendQueues.data(), queue);
+        m_queueingDelay[lane].add(g_get_monotonic_time() - queued.queuedTime);
+        queue->pop_front();
+        WPEAndroid::Trace::counter(Lane(lane) == Lane::Latency ? "IPC latency lane queued" : "IPC bulk lane queued", queue->size());
+    }
+
+    if (m_clientUnresponsive) {
+        ALOGW("IPC::Host: client of fd %d caught up", socketFd());
+        m_clientUnresponsive = false;
+    }
+    return false;
 }
 
 int Host::receiveFileDescriptor()
@@ -114,36 +286,43 @@ int Host::receiveFileDescriptor()
         return -result;
     }
 
+    // The data byte can arrive without a descriptor, if the sender passed an invalid one or ours
+    // was truncated for lack of room
     struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len < CMSG_LEN(sizeof(int))) {
+        ALOGV("No file descriptor in message read from socket");
+        return -EBADMSG;
+    }
+
     int fd;
     memmove(&fd, CMSG_DATA(cmsg), sizeof(fd));
 
+    m_flightRecorder.recordFileDescriptor(FlightRecorder::Direction::ReceivedFileDescriptor, fd);
     return fd;
 }
 
-gboolean Host::socketCallback(GSocket* socket, GIOCondition condition, gpointer data)
+bool Host::socketCallback()
 {
-    if (!(condition & G_IO_IN))
-        return TRUE;
-
-    auto& host = *static_cast<Host*>(data);
-
-    char* buffer = g_new0(char, Message::size);
-    GInputVector vector = { buffer, Message::size };
-    gssize len = g_socket_receive_message(socket, nullptr, &vector, 1,
+    GInputVector vector = { Message::data(m_received) + m_receivedOffset, Message::size - m_receivedOffset };
+    gssize len = g_socket_receive_message(m_socket, nullptr, &vector, 1,
         nullptr, nullptr, nullptr, nullptr, nullptr);
 
-    // If nothing is read, give up.
-    if (len == -1) {
-        g_free(buffer);
-        return FALSE;
-    }
-
-    if (len == Message::size)
-        host.m_handler->handleMessage(buffer, Message::size);
-
-    g_free(buffer);
-    return TRUE;
+    // If nothing is read, give up. The client closing its end reads as 0 bytes, over and over.
+    if (len <= 0)
+        return false;
+
+    // Only what is missing of this message is read, a file descriptor sent after it stays queued
+    m_receivedOffset += len;
+    if (m_receivedOffset < Message::size)
+        return true;
+    m_receivedOffset = 0;
+
+    Message message = m_received;
+    m_flightRecorder.recordMessage(FlightRecorder::Direction::Received, Message::data(message), Message::size);
+    if (Capture::isActive())
+        Capture::record(Capture::RecordType::Received, m_captureEndpoint, Message::data(message), Message::size);
+    m_handler->handleMessage(Message::data(message), Message::size);
+    return true;
 }
 
 Client::Client() = default;
@@ -156,19 +335,18 @@ void Client::initialize(Handler& handler, int fd)
     if (!m_socket)
         return;
 
-    m_source = g_socket_create_source(m_socket, G_IO_IN, nullptr);
-    g_source_set_name(m_source, "WPEBackend-android::socket");
-    g_source_set_callback(m_source, reinterpret_cast<GSourceFunc>(socketCallback), this, nullptr);
-    g_source_attach(m_source, g_main_context_get_thread_default());
+    m_flightRecorder.initialize("client", fd);
+
+    m_source = EventSource::create(fd, "WPEBackend-android::socket", [this] { return socketCallback(); });
 }
 
 void Client::deinitialize()
 {
-    if (m_source) {
-        g_source_destroy(m_source);
-        g_source_unref(m_source);
-    }
+    m_source = nullptr;
+    m_receivedOffset = 0;
 
+    if (m_socket)
+        m_flightRecorder.deinitialize();
     g_clear_object(&m_socket);
 
     m_handler = nullptr;
@@ -181,45 +359,101 @@ int Client::socketFd()
     return -1;
 }
 
-gboolean Client::socketCallback(GSocket* socket, GIOCondition condition, gpointer data)
+bool Client::readMessage(bool& closed)
 {
-    if (!(condition & G_IO_IN))
-        return TRUE;
-
-    GError* error = nullptr;
-    char* buffer = g_new0(char, Message::size);
-    gssize len = g_socket_receive(socket, buffer, Message::size, nullptr, &error);
-    if (len == -1) {
-        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED))
-            g_warning("Failed to read message from socket: %s", error->message);
-        g_error_free(error);
-        return FALSE;
+    closed = false;
+    while (m_receivedOffset < Message::size) {
+        GError* error = nullptr;
+        gssize len = g_socket_receive_with_blocking(m_socket, Message::data(m_received) + m_receivedOffset,
+            Message::size - m_receivedOffset, FALSE, nullptr, &error);
+        if (len == -1) {
+            closed = !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+            if (closed && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED))
+                g_warning("Failed to read message from socket: %s", error->message);
+            g_error_free(error);
+            return false;
+        }
+
+        // The host went away
+        if (!len) {
+            closed = true;
+            return false;
+        }
+        m_receivedOffset += len;
     }
 
-    auto client = reinterpret_cast<Client*>(data);
-    if (len == Message::size && client->m_handler)
-        client->m_handler->handleMessage(buffer, Message::size);
+    m_receivedOffset = 0;
+    m_flightRecorder.recordMessage(FlightRecorder::Direction::Received, Message::data(m_received), Message::size);
+    return true;
+}
 
-    g_free(buffer);
-    return TRUE;
+bool Client::socketCallback()
+{
+    // Everything already readable is taken at once and the latency lane handled first, so that
+    // frame feedback does not wait behind the pool management of other pools sent earlier
+    std::array<Message, receiveBatchSize> batch;
+    size_t count = 0;
+    bool closed = false;
+    while (count < batch.size() && readMessage(closed))
+        batch[count++] = m_received;
+
+    std::array<bool, receiveBatchSize> dispatched { };
+    for (size_t i = 0; i < count; ++i) {
+        if (laneOf(batch[i]) != Lane::Latency)
+            continue;
+        bool overtakes = false;
+        for (size_t j = 0; j < i && !overtakes; ++j)
+            overtakes = !dispatched[j] && mustPrecede(batch[j], batch[i]);
+        if (overtakes)
+            continue;
+        dispatched[i] = true;
+        if (m_handler)
+            m_handler->handleMessage(Message::data(batch[i]), Message::size);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!dispatched[i] && m_handler)
+            m_handler->handleMessage(Message::data(batch[i]), Message::size);
+    }
+    return !closed;
 }
 
 void Client::sendMessage(char* data, size_t size)
 {
+    m_flightRecorder.recordMessage(FlightRecorder::Direction::Sent, data, size);
     g_socket_send(m_socket, data, size, nullptr, nullptr);
 }
 
 void Client::sendAndReceiveMessage(char* data, size_t size, std::function<void(char*, size_t)> handler)
 {
+    m_flightRecorder.recordMessage(FlightRecorder::Direction::Sent, data, size);
     g_socket_send(m_socket, data, size, nullptr, nullptr);
 
-    char* buffer = g_new0(char, Message::size);
-    gssize len = g_socket_receive_with_blocking(m_socket, buffer, Message::size, TRUE, nullptr, nullptr);
+    bool closed = false;
+    while (!readMessage(closed)) {
+        if (closed || !g_socket_condition_timed_wait(m_socket, G_IO_IN, -1, nullptr, nullptr))
+            return;
+    }
 
-    if (len == Message::size)
-        handler(buffer, Message::size);
+    Message message = m_received;
+    handler(Message::data(message), Message::size);
+}
+
+bool Client::receiveMessage(char* data, size_t size, int64_t timeout)
+{
+    if (size != Message::size)
+        return false;
+
+    // The message may come in pieces, the wait for each of them shares the timeout
+    int64_t deadline = g_get_monotonic_time() + timeout;
+    bool closed = false;
+    while (!readMessage(closed)) {
+        int64_t remaining = deadline - g_get_monotonic_time();
+        if (closed || remaining <= 0 || !g_socket_condition_timed_wait(m_socket, G_IO_IN, remaining, nullptr, nullptr))
+            return false;
+    }
 
-    g_free(buffer);
+    memcpy(data, Message::data(m_received), size);
+    return true;
 }
 
 int Client::sendFileDescriptor(int fd)
@@ -254,7 +488,44 @@ int Client::sendFileDescriptor(int fd)
                 result, strerror(result));
         return -result;
     }
+
+    m_flightRecorder.recordFileDescriptor(FlightRecorder::Direction::SentFileDescriptor, fd);
     return NO_ERROR;
 }
 
+int createMessageSocket(char* data, size_t size)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) == -1)
+        return -1;
+
+    // Far smaller than the socket buffer, the write never blocks
+    ssize_t written;
+    do {
+        written = write(sockets[0], data, size);
+    } while (written == -1 && errno == EINTR);
+    close(sockets[0]);
+
+    if (written != ssize_t(size)) {
+        close(sockets[1]);
+        return -1;
+    }
+    return sockets[1];
+}
+
+bool readMessageSocket(int fd, char* data, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t len = read(fd, data + offset, size - offset);
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        offset += len;
+    }
+    close(fd);
+    return offset == size;
+}
+
 } // namespace IPC
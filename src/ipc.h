@@ -18,12 +18,18 @@
 
 #pragma once
 
+#include <array>
+#include <deque>
 #include <functional>
 #include <gio/gio.h>
 #include <memory>
 #include <stdint.h>
 #include <unistd.h>
 
+#include "event-source.h"
+#include "flight-recorder.h"
+#include "statistics.h"
+
 #define NO_ERROR 0L
 
 namespace IPC {
@@ -40,13 +46,32 @@ struct Message {
 };
 static_assert(sizeof(Message) == Message::size, "Message is of correct size");
 
+// Frame feedback travels in the latency lane, ahead of the pool management of the bulk lane.
+// Only messages of different pools are reordered, see mustPrecede().
+enum class Lane : uint8_t {
+    Latency,
+    Bulk,
+};
+static const size_t laneCount = 2;
+
+Lane laneOf(const Message&);
+
+// Whether later may not overtake earlier. Messages of the same pool keep their order across lanes,
+// and so do messages of the connection itself, like the handshake, with everything else.
+bool mustPrecede(const Message& earlier, const Message& later);
+
 class Host {
 public:
     class Handler {
     public:
         virtual void handleMessage(char*, size_t) = 0;
+        // The client stopped reading long enough to fill the send queues past their high-water mark
+        virtual void clientBecameUnresponsive() { }
     };
 
+    // Queued messages past which the client is deemed unresponsive
+    static const size_t sendQueueHighWaterMark = 1024;
+
     Host();
 
     void initialize(Handler&);
@@ -55,17 +80,63 @@ public:
     int socketFd();
     int releaseClientFD(bool closeSourceFd = false);
 
-    void sendMessage(char*, size_t);
+    // Closes the connection once its stream cannot be trusted anymore. The client sees it closed,
+    // and the socket stops being watched on its next read.
+    void shutdown();
+
+    // Folds a message into a queued one if possible, returning whether it did
+    using MergeFunction = bool (*)(Message& queued, const Message&);
+
+    // Never blocks: what the socket cannot take right away is queued and flushed once it is
+    // writable, latency lane first. With a merge function, the message is folded into the most
+    // recent queued message accepting it that it may overtake, see mustPrecede(). Nothing is ever
+    // dropped: once the queues reach their high-water mark the client is flagged unresponsive
+    // until it has read everything.
+    void sendMessage(char*, size_t, MergeFunction merge = nullptr);
     int receiveFileDescriptor();
 
+    bool isClientUnresponsive() const { return m_clientUnresponsive; }
+
+    // Time from sendMessage() until the message is entirely in the socket, per lane
+    const WPEAndroid::LatencyHistogram& queueingDelay(Lane lane) const { return m_queueingDelay[size_t(lane)]; }
+
+    const FlightRecorder& flightRecorder() const { return m_flightRecorder; }
+    // Identifies this host in IPC captures
+    uint32_t captureEndpoint() const { return m_captureEndpoint; }
+
 private:
-    static gboolean socketCallback(GSocket*, GIOCondition, gpointer);
+    bool socketCallback();
+
+    struct QueuedMessage {
+        Message message;
+        size_t offset;
+        int64_t queuedTime;
+    };
+    using SendQueue = std::deque<QueuedMessage>;
+
+    // Returns false if the socket is broken, a message that would block is left partially written
+    bool write(QueuedMessage&);
+    bool flushSendQueues();
+    // A partially written message comes first, to keep the stream framed
+    SendQueue* nextSendQueue();
+    size_t queuedMessages() const;
 
     Handler* m_handler { nullptr };
 
     GSocket* m_socket { nullptr };
-    GSource* m_source { nullptr };
+    std::unique_ptr<EventSource> m_source;
     int m_clientFd { -1 };
+
+    std::array<SendQueue, laneCount> m_sendQueues;
+    std::array<WPEAndroid::LatencyHistogram, laneCount> m_queueingDelay;
+    bool m_clientUnresponsive { false };
+
+    // A message may arrive in pieces, the part read so far waits here for the rest
+    Message m_received;
+    size_t m_receivedOffset { 0 };
+
+    FlightRecorder m_flightRecorder;
+    uint32_t m_captureEndpoint { 0 };
 };
 
 class Client {
@@ -84,15 +155,36 @@ public:
 
     void sendMessage(char*, size_t);
     void sendAndReceiveMessage(char*, size_t, std::function<void(char*, size_t)> handler);
+    // Waits up to timeout microseconds for a message and reads it without going through the handler
+    bool receiveMessage(char*, size_t, int64_t timeout);
     int sendFileDescriptor(int fd);
 
+    const FlightRecorder& flightRecorder() const { return m_flightRecorder; }
+
 private:
-    static gboolean socketCallback(GSocket*, GIOCondition, gpointer);
+    // Messages read from the socket per wakeup, at most
+    static const size_t receiveBatchSize = 16;
+
+    bool socketCallback();
+    // Reads without blocking what is missing of the message being received, returns whether it
+    // is complete in m_received. closed is set once the host went away.
+    bool readMessage(bool& closed);
 
     Handler* m_handler { nullptr };
 
     GSocket* m_socket { nullptr };
-    GSource* m_source { nullptr };
+    std::unique_ptr<EventSource> m_source;
+
+    Message m_received;
+    size_t m_receivedOffset { 0 };
+
+    FlightRecorder m_flightRecorder;
 };
 
+// A socket carrying a single message, written up front, needs no event source on either side.
+// Returns the end to hand over to the reader, or -1.
+int createMessageSocket(char*, size_t);
+// Blocks until the message written by createMessageSocket() is read, and closes fd
+bool readMessageSocket(int fd, char*, size_t);
+
 } // namespace IPC
@@ -18,7 +18,7 @@
 
 #pragma once
 
-#include <android/log.h>
+#include "platform.h"
 
 #ifndef LOG_NDEBUG
 #ifdef NDEBUG
@@ -37,10 +37,10 @@
 #if LOG_NDEBUG
 #define ALOGV(...)  ((void)(0))
 #else
-#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGV(...) WPEAndroid::Platform::log(WPEAndroid::Platform::LogLevel::Verbose, LOG_TAG, __VA_ARGS__)
 #endif
 
-#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
-#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) WPEAndroid::Platform::log(WPEAndroid::Platform::LogLevel::Debug, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) WPEAndroid::Platform::log(WPEAndroid::Platform::LogLevel::Info, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) WPEAndroid::Platform::log(WPEAndroid::Platform::LogLevel::Warn, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) WPEAndroid::Platform::log(WPEAndroid::Platform::LogLevel::Error, LOG_TAG, __VA_ARGS__)
@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pixel-kernels.h"
+
+#if defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+namespace WPEAndroid {
+
+namespace PixelKernels {
+
+static void swizzleRGBAToBGRANEON(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+        uint8x16_t r = pixels.val[0];
+        pixels.val[0] = pixels.val[2];
+        pixels.val[2] = r;
+        vst4q_u8(dst + x * 4, pixels);
+    }
+    scalarKernels().swizzleRGBAToBGRA(src + x * 4, dst + x * 4, width - x);
+}
+
+#if defined(__aarch64__)
+// Only AArch64 has a vector division that rounds exactly like the scalar reference
+static inline uint32x4_t unpremultiplyChannel(uint16x4_t channel, float32x4_t alpha, uint32x4_t transparent)
+{
+    float32x4_t value = vdivq_f32(vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(channel)), 255.f), alpha);
+    value = vminq_f32(vaddq_f32(value, vdupq_n_f32(0.5f)), vdupq_n_f32(255.f));
+    return vbicq_u32(vcvtq_u32_f32(value), transparent);
+}
+
+static inline uint8x8_t unpremultiplyChannel(uint8x8_t channel, uint16x8_t alpha)
+{
+    uint16x8_t wide = vmovl_u8(channel);
+
+    float32x4_t alphaLow = vcvtq_f32_u32(vmovl_u16(vget_low_u16(alpha)));
+    float32x4_t alphaHigh = vcvtq_f32_u32(vmovl_u16(vget_high_u16(alpha)));
+    uint32x4_t low = unpremultiplyChannel(vget_low_u16(wide), alphaLow, vceqq_f32(alphaLow, vdupq_n_f32(0)));
+    uint32x4_t high = unpremultiplyChannel(vget_high_u16(wide), alphaHigh, vceqq_f32(alphaHigh, vdupq_n_f32(0)));
+
+    return vmovn_u16(vcombine_u16(vmovn_u32(low), vmovn_u32(high)));
+}
+
+static void unpremultiplyNEON(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t pixels = vld4_u8(src + x * 4);
+        uint16x8_t alpha = vmovl_u8(pixels.val[3]);
+        for (int c = 0; c < 3; ++c)
+            pixels.val[c] = unpremultiplyChannel(pixels.val[c], alpha);
+        vst4_u8(dst + x * 4, pixels);
+    }
+    scalarKernels().unpremultiply(src + x * 4, dst + x * 4, width - x);
+}
+#endif
+
+static void halveNEON(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x16x4_t a = vld4q_u8(row0 + x * 8);
+        uint8x16x4_t b = vld4q_u8(row1 + x * 8);
+
+        uint8x8x4_t result;
+        for (int c = 0; c < 4; ++c) {
+            // Pairwise sums of horizontally adjacent pixels, then (sum + 2) >> 2
+            uint16x8_t sum = vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c]));
+            result.val[c] = vrshrn_n_u16(sum, 2);
+        }
+        vst4_u8(dst + x * 4, result);
+    }
+    scalarKernels().halve(row0 + x * 8, row1 + x * 8, dst + x * 4, width - x);
+}
+
+const Kernels* neonKernels()
+{
+#if defined(__aarch64__)
+    static const Kernels kernels { "neon", swizzleRGBAToBGRANEON, unpremultiplyNEON, halveNEON };
+#else
+    static const Kernels kernels { "neon", swizzleRGBAToBGRANEON, scalarKernels().unpremultiply, halveNEON };
+#endif
+    return &kernels;
+}
+
+} // namespace PixelKernels
+
+} // namespace WPEAndroid
+
+#endif // defined(__ARM_NEON)
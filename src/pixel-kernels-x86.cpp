@@ -0,0 +1,198 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pixel-kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Each implementation is compiled for its own instruction set through target attributes, so the
+// library itself keeps the baseline ABI and picks the implementation at runtime.
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace WPEAndroid {
+
+namespace PixelKernels {
+
+// SSSE3
+
+TARGET_SSSE3 static void swizzleRGBAToBGRASSSE3(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_shuffle_epi8(pixels, mask));
+    }
+    scalarKernels().swizzleRGBAToBGRA(src + x * 4, dst + x * 4, width - x);
+}
+
+// Unpremultiplies a single pixel held as four floats
+TARGET_SSSE3 static inline __m128 unpremultiplyPixel(__m128 pixel)
+{
+    const __m128 alphaLane = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+    __m128 alpha = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 value = _mm_div_ps(_mm_mul_ps(pixel, _mm_set1_ps(255.f)), alpha);
+    value = _mm_min_ps(_mm_add_ps(value, _mm_set1_ps(0.5f)), _mm_set1_ps(255.f));
+    value = _mm_andnot_ps(_mm_cmpeq_ps(alpha, _mm_setzero_ps()), value);
+    return _mm_or_ps(_mm_andnot_ps(alphaLane, value), _mm_and_ps(alphaLane, pixel));
+}
+
+TARGET_SSSE3 static void unpremultiplySSSE3(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        __m128i p0 = _mm_cvttps_epi32(unpremultiplyPixel(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero))));
+        __m128i p1 = _mm_cvttps_epi32(unpremultiplyPixel(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero))));
+        __m128i p2 = _mm_cvttps_epi32(unpremultiplyPixel(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero))));
+        __m128i p3 = _mm_cvttps_epi32(unpremultiplyPixel(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero))));
+
+        __m128i result = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), result);
+    }
+    scalarKernels().unpremultiply(src + x * 4, dst + x * 4, width - x);
+}
+
+TARGET_SSSE3 static void halveSSSE3(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(2);
+
+    uint32_t x = 0;
+    for (; x + 2 <= width; x += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+        // Vertical sums of source pixels 0,1 and 2,3 as 16-bit channels
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+        // Horizontal sums into the low half of each register
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+        __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), rounding), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(sum, sum));
+    }
+    scalarKernels().halve(row0 + x * 8, row1 + x * 8, dst + x * 4, width - x);
+}
+
+const Kernels* ssse3Kernels()
+{
+    static const Kernels kernels { "ssse3", swizzleRGBAToBGRASSSE3, unpremultiplySSSE3, halveSSSE3 };
+    if (!__builtin_cpu_supports("ssse3"))
+        return nullptr;
+    return &kernels;
+}
+
+// AVX2
+
+TARGET_AVX2 static void swizzleRGBAToBGRAAVX2(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), _mm256_shuffle_epi8(pixels, mask));
+    }
+    scalarKernels().swizzleRGBAToBGRA(src + x * 4, dst + x * 4, width - x);
+}
+
+// Unpremultiplies two pixels, one per 128-bit lane
+TARGET_AVX2 static inline __m256i unpremultiplyPixels(__m128i pixels)
+{
+    const __m256 alphaLane = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+
+    __m256 pixel = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(pixels));
+    __m256 alpha = _mm256_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+    __m256 value = _mm256_div_ps(_mm256_mul_ps(pixel, _mm256_set1_ps(255.f)), alpha);
+    value = _mm256_min_ps(_mm256_add_ps(value, _mm256_set1_ps(0.5f)), _mm256_set1_ps(255.f));
+    value = _mm256_andnot_ps(_mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_EQ_OQ), value);
+    return _mm256_cvttps_epi32(_mm256_blendv_ps(value, pixel, alphaLane));
+}
+
+TARGET_AVX2 static void unpremultiplyAVX2(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        __m128i lo = _mm256_castsi256_si128(pixels);
+        __m128i hi = _mm256_extracti128_si256(pixels, 1);
+
+        __m256i p01 = unpremultiplyPixels(lo);
+        __m256i p23 = unpremultiplyPixels(_mm_srli_si128(lo, 8));
+        __m256i p45 = unpremultiplyPixels(hi);
+        __m256i p67 = unpremultiplyPixels(_mm_srli_si128(hi, 8));
+
+        // Packing works per lane, leaving pixels ordered 0,2,4,6,1,3,5,7 as 32-bit words
+        __m256i result = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+        result = _mm256_permutevar8x32_epi32(result, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), result);
+    }
+    scalarKernels().unpremultiply(src + x * 4, dst + x * 4, width - x);
+}
+
+TARGET_AVX2 static void halveAVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i rounding = _mm256_set1_epi16(2);
+
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8));
+
+        // Per lane: vertical sums of source pixels 0,1 | 4,5 and 2,3 | 6,7
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+
+        lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+        hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+
+        __m256i sum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), rounding), 2);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm256_castsi256_si128(packed));
+    }
+    scalarKernels().halve(row0 + x * 8, row1 + x * 8, dst + x * 4, width - x);
+}
+
+const Kernels* avx2Kernels()
+{
+    static const Kernels kernels { "avx2", swizzleRGBAToBGRAAVX2, unpremultiplyAVX2, halveAVX2 };
+    if (!__builtin_cpu_supports("avx2"))
+        return nullptr;
+    return &kernels;
+}
+
+} // namespace PixelKernels
+
+} // namespace WPEAndroid
+
+#endif // defined(__x86_64__) || defined(__i386__)
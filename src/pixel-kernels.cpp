@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pixel-kernels.h"
+
+#include <algorithm>
+
+namespace WPEAndroid {
+
+namespace PixelKernels {
+
+static void swizzleRGBAToBGRAScalar(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        uint8_t r = src[0];
+        uint8_t g = src[1];
+        uint8_t b = src[2];
+        uint8_t a = src[3];
+        dst[0] = b;
+        dst[1] = g;
+        dst[2] = r;
+        dst[3] = a;
+    }
+}
+
+// Reference for the SIMD implementations, which must produce identical results:
+// round(c * 255 / a) computed in single precision, transparent pixels become zero.
+static void unpremultiplyScalar(const uint8_t* src, uint8_t* dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        uint8_t a = src[3];
+        for (int c = 0; c < 3; ++c) {
+            if (!a) {
+                dst[c] = 0;
+                continue;
+            }
+            float value = float(src[c]) * 255.f / float(a) + 0.5f;
+            dst[c] = uint8_t(std::min(value, 255.f));
+        }
+        dst[3] = a;
+    }
+}
+
+static void halveScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; ++x, row0 += 8, row1 += 8, dst += 4) {
+        for (int c = 0; c < 4; ++c)
+            dst[c] = uint8_t((row0[c] + row0[c + 4] + row1[c] + row1[c + 4] + 2) >> 2);
+    }
+}
+
+const Kernels& scalarKernels()
+{
+    static const Kernels kernels { "scalar", swizzleRGBAToBGRAScalar, unpremultiplyScalar, halveScalar };
+    return kernels;
+}
+
+static const Kernels& selectKernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (auto* kernels = avx2Kernels())
+        return *kernels;
+    if (auto* kernels = ssse3Kernels())
+        return *kernels;
+#endif
+#if defined(__ARM_NEON)
+    if (auto* kernels = neonKernels())
+        return *kernels;
+#endif
+    return scalarKernels();
+}
+
+const Kernels& kernels()
+{
+    static const Kernels& kernels = selectKernels();
+    return kernels;
+}
+
+std::vector<const Kernels*> availableKernels()
+{
+    std::vector<const Kernels*> result { &scalarKernels() };
+#if defined(__x86_64__) || defined(__i386__)
+    if (auto* kernels = ssse3Kernels())
+        result.push_back(kernels);
+    if (auto* kernels = avx2Kernels())
+        result.push_back(kernels);
+#endif
+#if defined(__ARM_NEON)
+    if (auto* kernels = neonKernels())
+        result.push_back(kernels);
+#endif
+    return result;
+}
+
+void swizzleRGBAToBGRA(const Kernels& kernels, const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; ++y)
+        kernels.swizzleRGBAToBGRA(src + size_t(y) * srcStride, dst + size_t(y) * dstStride, width);
+}
+
+void unpremultiply(const Kernels& kernels, const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; ++y)
+        kernels.unpremultiply(src + size_t(y) * srcStride, dst + size_t(y) * dstStride, width);
+}
+
+void boxDownscale(const Kernels& kernels, const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcStride,
+    uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstStride)
+{
+    if (dstWidth * 2 == srcWidth && dstHeight * 2 == srcHeight) {
+        for (uint32_t y = 0; y < dstHeight; ++y) {
+            const uint8_t* row0 = src + size_t(y) * 2 * srcStride;
+            kernels.halve(row0, row0 + srcStride, dst + size_t(y) * dstStride, dstWidth);
+        }
+        return;
+    }
+
+    for (uint32_t dy = 0; dy < dstHeight; ++dy) {
+        uint32_t y0 = uint64_t(dy) * srcHeight / dstHeight;
+        uint32_t y1 = std::max<uint32_t>(y0 + 1, uint64_t(dy + 1) * srcHeight / dstHeight);
+
+        uint8_t* row = dst + size_t(dy) * dstStride;
+        for (uint32_t dx = 0; dx < dstWidth; ++dx) {
+            uint32_t x0 = uint64_t(dx) * srcWidth / dstWidth;
+            uint32_t x1 = std::max<uint32_t>(x0 + 1, uint64_t(dx + 1) * srcWidth / dstWidth);
+
+            uint32_t sum[4] = { 0, 0, 0, 0 };
+            for (uint32_t y = y0; y < y1; ++y) {
+                const uint8_t* pixel = src + size_t(y) * srcStride + size_t(x0) * 4;
+                for (uint32_t x = x0; x < x1; ++x, pixel += 4) {
+                    sum[0] += pixel[0];
+                    sum[1] += pixel[1];
+                    sum[2] += pixel[2];
+                    sum[3] += pixel[3];
+                }
+            }
+
+            uint32_t count = (x1 - x0) * (y1 - y0);
+            for (int c = 0; c < 4; ++c)
+                row[dx * 4 + c] = uint8_t((sum[c] + count / 2) / count);
+        }
+    }
+}
+
+} // namespace PixelKernels
+
+} // namespace WPEAndroid
@@ -0,0 +1,60 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace WPEAndroid {
+
+namespace PixelKernels {
+
+// Row kernels over 32bpp RGBA8 pixels. src and dst may alias for the in-place conversions.
+struct Kernels {
+    const char* name;
+
+    void (*swizzleRGBAToBGRA)(const uint8_t* src, uint8_t* dst, uint32_t width);
+    void (*unpremultiply)(const uint8_t* src, uint8_t* dst, uint32_t width);
+    // 2x2 box filter of two source rows into one row of width destination pixels
+    void (*halve)(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t width);
+};
+
+const Kernels& scalarKernels();
+#if defined(__x86_64__) || defined(__i386__)
+const Kernels* ssse3Kernels();
+const Kernels* avx2Kernels();
+#endif
+#if defined(__ARM_NEON)
+const Kernels* neonKernels();
+#endif
+
+// Fastest implementation supported by the running CPU
+const Kernels& kernels();
+// Every implementation supported by the running CPU, scalar reference first
+std::vector<const Kernels*> availableKernels();
+
+void swizzleRGBAToBGRA(const Kernels&, const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height);
+void unpremultiply(const Kernels&, const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height);
+// Averages all source pixels covered by each destination pixel, exact halving uses the SIMD kernel
+void boxDownscale(const Kernels&, const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcStride,
+    uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstStride);
+
+} // namespace PixelKernels
+
+} // namespace WPEAndroid
@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <wpe-android/pixels.h>
+
+#include <cstring>
+
+#include "pixel-kernels.h"
+#include "platform.h"
+
+using namespace WPEAndroid;
+
+// Formats with four 8-bit channels in RGBA memory order
+static bool isRGBA8(uint32_t format)
+{
+    return format == AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM || format == AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM;
+}
+
+extern "C" {
+
+__attribute__((visibility("default")))
+bool WPEAndroidPixels_swizzleRGBAToBGRA(uint32_t format, const void* src, uint32_t srcStride,
+    void* dst, uint32_t dstStride, uint32_t width, uint32_t height)
+{
+    if (!isRGBA8(format))
+        return false;
+
+    PixelKernels::swizzleRGBAToBGRA(PixelKernels::kernels(), static_cast<const uint8_t*>(src), srcStride,
+        static_cast<uint8_t*>(dst), dstStride, width, height);
+    return true;
+}
+
+__attribute__((visibility("default")))
+bool WPEAndroidPixels_unpremultiply(uint32_t format, const void* src, uint32_t srcStride,
+    void* dst, uint32_t dstStride, uint32_t width, uint32_t height)
+{
+    if (!isRGBA8(format))
+        return false;
+
+    // Opaque formats have nothing to unpremultiply
+    if (format == AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM) {
+        if (src != dst) {
+            for (uint32_t y = 0; y < height; ++y)
+                std::memcpy(static_cast<uint8_t*>(dst) + size_t(y) * dstStride, static_cast<const uint8_t*>(src) + size_t(y) * srcStride, size_t(width) * 4);
+        }
+        return true;
+    }
+
+    PixelKernels::unpremultiply(PixelKernels::kernels(), static_cast<const uint8_t*>(src), srcStride,
+        static_cast<uint8_t*>(dst), dstStride, width, height);
+    return true;
+}
+
+__attribute__((visibility("default")))
+bool WPEAndroidPixels_boxDownscale(uint32_t format, const void* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcStride,
+    void* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstStride)
+{
+    if (!isRGBA8(format) || !dstWidth || !dstHeight || dstWidth > srcWidth || dstHeight > srcHeight)
+        return false;
+
+    PixelKernels::boxDownscale(PixelKernels::kernels(), static_cast<const uint8_t*>(src), srcWidth, srcHeight, srcStride,
+        static_cast<uint8_t*>(dst), dstWidth, dstHeight, dstStride);
+    return true;
+}
+
+} // extern "C"
@@ -0,0 +1,157 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "platform.h"
+
+#include <GLES2/gl2.h>
+#include <android/log.h>
+#include <android/trace.h>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+
+namespace WPEAndroid {
+
+namespace Platform {
+
+void log(LogLevel level, const char* tag, const char* format, ...)
+{
+    static const int priorities[] = { ANDROID_LOG_VERBOSE, ANDROID_LOG_DEBUG, ANDROID_LOG_INFO, ANDROID_LOG_WARN, ANDROID_LOG_ERROR };
+
+    va_list args;
+    va_start(args, format);
+    __android_log_vprint(priorities[static_cast<int>(level)], tag, format, args);
+    va_end(args);
+}
+
+bool traceEnabled()
+{
+    return ATrace_isEnabled();
+}
+
+void traceBegin(const char* name)
+{
+    ATrace_beginSection(name);
+}
+
+void traceEnd()
+{
+    ATrace_endSection();
+}
+
+void traceCounter(const char* name, int64_t value)
+{
+#if __ANDROID_API__ >= 29
+    ATrace_setCounter(name, value);
+#else
+    (void)name;
+    (void)value;
+#endif
+}
+
+void traceFlow(const char* name, uint64_t id, TraceFlow)
+{
+    // atrace has no flow events, an empty section carrying the ID makes each step searchable
+    char section[64];
+    std::snprintf(section, sizeof(section), "%s %" PRIx64, name, id);
+    ATrace_beginSection(section);
+    ATrace_endSection();
+}
+
+int allocateBuffer(const AHardwareBuffer_Desc* description, AHardwareBuffer** buffer)
+{
+    return AHardwareBuffer_allocate(description, buffer);
+}
+
+void acquireBuffer(AHardwareBuffer* buffer)
+{
+    AHardwareBuffer_acquire(buffer);
+}
+
+void releaseBuffer(AHardwareBuffer* buffer)
+{
+    AHardwareBuffer_release(buffer);
+}
+
+void describeBuffer(const AHardwareBuffer* buffer, AHardwareBuffer_Desc* description)
+{
+    AHardwareBuffer_describe(buffer, description);
+}
+
+int lockBuffer(AHardwareBuffer* buffer, uint64_t usage, int fence, void** address)
+{
+    return AHardwareBuffer_lock(buffer, usage, fence, nullptr, address);
+}
+
+int unlockBuffer(AHardwareBuffer* buffer)
+{
+    return AHardwareBuffer_unlock(buffer, nullptr);
+}
+
+int sendBuffer(const AHardwareBuffer* buffer, int socketFd)
+{
+    return AHardwareBuffer_sendHandleToUnixSocket(buffer, socketFd);
+}
+
+int receiveBuffer(int socketFd, AHardwareBuffer** buffer)
+{
+    return AHardwareBuffer_recvHandleFromUnixSocket(socketFd, buffer);
+}
+
+static PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC getNativeClientBufferANDROID()
+{
+    static auto function = reinterpret_cast<PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC>(
+        eglGetProcAddress("eglGetNativeClientBufferANDROID"));
+    return function;
+}
+
+bool supportsBufferImport()
+{
+    return !!getNativeClientBufferANDROID();
+}
+
+EGLClientBuffer clientBuffer(AHardwareBuffer* buffer)
+{
+    return getNativeClientBufferANDROID()(buffer);
+}
+
+int createNativeFence(EGLDisplay display)
+{
+    static auto createSyncKHR = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(
+        eglGetProcAddress("eglCreateSyncKHR"));
+    static auto destroySyncKHR = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(
+        eglGetProcAddress("eglDestroySyncKHR"));
+    static auto dupNativeFenceFDANDROID = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(
+        eglGetProcAddress("eglDupNativeFenceFDANDROID"));
+
+    EGLSyncKHR sync = createSyncKHR(display, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+
+    glFlush();
+
+    if (sync == EGL_NO_SYNC_KHR)
+        return -1;
+
+    // native fence fd will not be populated until flush() is done
+    int fd = dupNativeFenceFDANDROID(display, sync);
+    destroySyncKHR(display, sync);
+    return fd == EGL_NO_NATIVE_FENCE_FD_ANDROID ? -1 : fd;
+}
+
+} // namespace Platform
+
+} // namespace WPEAndroid
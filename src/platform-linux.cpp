@@ -0,0 +1,316 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "platform.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include <cstdlib>
+#include <ctime>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "shared-memory.h"
+
+// Buffers are plain memfd regions with tightly packed 32bpp pixels. They can't be imported into
+// EGL, so renderers use the shared memory path, which Mesa's surfaceless platform can render to.
+struct AHardwareBuffer {
+    AHardwareBuffer_Desc description;
+    WPEAndroid::SharedMemory memory;
+    std::atomic<int> refCount { 1 };
+};
+
+namespace WPEAndroid {
+
+namespace Platform {
+
+void log(LogLevel level, const char* tag, const char* format, ...)
+{
+    static const char levels[] = { 'V', 'D', 'I', 'W', 'E' };
+
+    va_list args;
+    va_start(args, format);
+    std::fprintf(stderr, "%c/%s: ", levels[static_cast<int>(level)], tag);
+    std::vfprintf(stderr, format, args);
+    std::fputc('\n', stderr);
+    va_end(args);
+}
+
+// Chrome JSON trace named by WPE_ANDROID_TRACE_FILE, shared by all processes through O_APPEND.
+// The event array is never terminated, which trace viewers accept.
+class TraceFile {
+public:
+    TraceFile()
+    {
+        const char* path = std::getenv("WPE_ANDROID_TRACE_FILE");
+        if (!path || !*path)
+            return;
+
+        m_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd != -1) {
+            static const char header[] = "[\n";
+            if (::write(m_fd, header, sizeof(header) - 1) == -1)
+                ALOGW("Cannot write trace file %s: %s", path, std::strerror(errno));
+        } else if (errno == EEXIST)
+            m_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+
+        if (m_fd == -1)
+            ALOGW("Cannot open trace file %s: %s", path, std::strerror(errno));
+    }
+
+    bool isOpen() const { return m_fd != -1; }
+
+    // Writes one event, arguments is either empty or a list of extra JSON members starting with a comma
+    void write(char phase, const char* name, const char* arguments = "")
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        char event[256];
+        int length = std::snprintf(event, sizeof(event),
+            "{\"ph\":\"%c\",\"cat\":\"wpe\",\"name\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld%s},\n",
+            phase, name, now.tv_sec * 1e6 + now.tv_nsec / 1e3, getpid(), syscall(SYS_gettid), arguments);
+        if (length > 0 && size_t(length) < sizeof(event))
+            (void)!::write(m_fd, event, length);
+    }
+
+private:
+    int m_fd { -1 };
+};
+
+static TraceFile& traceFile()
+{
+    static TraceFile file;
+    return file;
+}
+
+bool traceEnabled()
+{
+    return traceFile().isOpen();
+}
+
+void traceBegin(const char* name)
+{
+    traceFile().write('B', name);
+}
+
+void traceEnd()
+{
+    traceFile().write('E', "");
+}
+
+void traceCounter(const char* name, int64_t value)
+{
+    char arguments[64];
+    std::snprintf(arguments, sizeof(arguments), ",\"args\":{\"value\":%" PRId64 "}", value);
+    traceFile().write('C', name, arguments);
+}
+
+void traceFlow(const char* name, uint64_t id, TraceFlow flow)
+{
+    // Flow events bind to the section enclosing them, the last one to the section it ends in
+    static const char phases[] = { 's', 't', 'f' };
+
+    char arguments[64];
+    std::snprintf(arguments, sizeof(arguments), ",\"id\":\"0x%" PRIx64 "\"%s", id, flow == TraceFlow::End ? ",\"bp\":\"e\"" : "");
+    traceFile().write(phases[static_cast<int>(flow)], name, arguments);
+}
+
+static size_t bufferSize(const AHardwareBuffer_Desc& description)
+{
+    return size_t(description.stride) * description.height * 4;
+}
+
+int allocateBuffer(const AHardwareBuffer_Desc* description, AHardwareBuffer** buffer)
+{
+    if (description->format != AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM && description->format != AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM)
+        return -EINVAL;
+
+    auto* object = new AHardwareBuffer;
+    object->description = *description;
+    object->description.stride = description->width;
+    if (!object->memory.allocate(bufferSize(object->description))) {
+        delete object;
+        return -ENOMEM;
+    }
+
+    *buffer = object;
+    return 0;
+}
+
+void acquireBuffer(AHardwareBuffer* buffer)
+{
+    buffer->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void releaseBuffer(AHardwareBuffer* buffer)
+{
+    if (buffer->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete buffer;
+}
+
+void describeBuffer(const AHardwareBuffer* buffer, AHardwareBuffer_Desc* description)
+{
+    *description = buffer->description;
+}
+
+int lockBuffer(AHardwareBuffer* buffer, uint64_t, int fence, void** address)
+{
+    // Buffers are never written by a GPU, so there is nothing to wait for
+    if (fence != -1)
+        close(fence);
+
+    *address = buffer->memory.data();
+    return 0;
+}
+
+int unlockBuffer(AHardwareBuffer*)
+{
+    return 0;
+}
+
+int sendBuffer(const AHardwareBuffer* buffer, int socketFd)
+{
+    int fd = buffer->memory.fd();
+
+    struct msghdr msg = { };
+    char control[CMSG_SPACE(sizeof(fd))];
+    std::memset(control, 0, sizeof(control));
+
+    struct iovec io = { const_cast<AHardwareBuffer_Desc*>(&buffer->description), sizeof(AHardwareBuffer_Desc) };
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+    ssize_t result;
+    do {
+        result = sendmsg(socketFd, &msg, 0);
+    } while (result == -1 && errno == EINTR);
+    return result == -1 ? -errno : 0;
+}
+
+// Reads the rest of a message whose beginning was already received. The sender wrote all of it at
+// once, so it is on its way.
+static bool receiveRemainder(int socketFd, char* data, size_t size)
+{
+    static const int s_timeoutMilliseconds = 1000;
+
+    size_t received = 0;
+    while (received < size) {
+        ssize_t result = recv(socketFd, data + received, size - received, 0);
+        if (result > 0) {
+            received += result;
+            continue;
+        }
+        if (!result)
+            return false;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return false;
+
+        struct pollfd pollFd = { socketFd, POLLIN, 0 };
+        if (poll(&pollFd, 1, s_timeoutMilliseconds) <= 0)
+            return false;
+    }
+    return true;
+}
+
+int receiveBuffer(int socketFd, AHardwareBuffer** buffer)
+{
+    AHardwareBuffer_Desc description;
+
+    struct msghdr msg = { };
+    char control[CMSG_SPACE(sizeof(int))];
+
+    struct iovec io = { &description, sizeof(description) };
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t result;
+    do {
+        result = recvmsg(socketFd, &msg, 0);
+    } while (result == -1 && errno == EINTR);
+    if (result == -1)
+        return -errno;
+    if (!result)
+        return -EPIPE;
+
+    int fd = -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len >= CMSG_LEN(sizeof(int)))
+        std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+    // The descriptor comes with the first bytes, the rest of the description may follow. Without
+    // all of it the stream is out of step.
+    if (size_t(result) < sizeof(description)
+        && !receiveRemainder(socketFd, reinterpret_cast<char*>(&description) + result, sizeof(description) - result)) {
+        if (fd != -1)
+            close(fd);
+        return -EPIPE;
+    }
+    if (fd == -1)
+        return -EBADMSG;
+
+    auto* object = new AHardwareBuffer;
+    object->description = description;
+    if (!object->memory.map(fd, bufferSize(description))) {
+        delete object;
+        return -ENOMEM;
+    }
+
+    *buffer = object;
+    return 0;
+}
+
+bool supportsBufferImport()
+{
+    return false;
+}
+
+EGLClientBuffer clientBuffer(AHardwareBuffer*)
+{
+    return nullptr;
+}
+
+int createNativeFence(EGLDisplay)
+{
+    // Only shared memory buffers are used here, their readback already waits for rendering
+    return -1;
+}
+
+} // namespace Platform
+
+} // namespace WPEAndroid
@@ -0,0 +1,140 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Thin layer over everything the backend needs from the operating system beyond sockets and
+// GLib: logging, tracing, buffer allocation and transfer, EGL import and fences.
+// platform-android.cpp implements it on top of the NDK, platform-linux.cpp with memfd-backed
+// buffers and Mesa's surfaceless EGL platform so that the backend can be built and profiled
+// on desktop Linux.
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdint>
+
+#if defined(__ANDROID__)
+#include <android/hardware_buffer.h>
+#else
+// The subset of <android/hardware_buffer.h> used by the backend, with the same values
+typedef struct AHardwareBuffer AHardwareBuffer;
+
+typedef struct AHardwareBuffer_Desc {
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    uint32_t format;
+    uint64_t usage;
+    uint32_t stride;
+    uint32_t rfu0;
+    uint64_t rfu1;
+} AHardwareBuffer_Desc;
+
+enum {
+    AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM = 1,
+    AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM = 2,
+    AHARDWAREBUFFER_FORMAT_R5G6B5_UNORM = 4,
+    AHARDWAREBUFFER_FORMAT_R16G16B16A16_FLOAT = 0x16,
+    AHARDWAREBUFFER_FORMAT_R10G10B10A2_UNORM = 0x2b,
+};
+
+enum : uint64_t {
+    AHARDWAREBUFFER_USAGE_CPU_READ_RARELY = 2UL,
+    AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN = 3UL,
+    AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE = 1UL << 8,
+    AHARDWAREBUFFER_USAGE_GPU_FRAMEBUFFER = 1UL << 9,
+    AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY = 1UL << 11,
+};
+#endif
+
+namespace WPEAndroid {
+
+namespace Platform {
+
+// Logging
+
+enum class LogLevel {
+    Verbose,
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+void log(LogLevel, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+// Tracing, use the wrappers in trace.h rather than calling these directly
+
+enum class TraceFlow {
+    Begin,
+    Step,
+    End,
+};
+
+bool traceEnabled();
+void traceBegin(const char* name);
+void traceEnd();
+void traceCounter(const char* name, int64_t value);
+// Flows link trace sections of both processes that belong to the same frame
+void traceFlow(const char* name, uint64_t id, TraceFlow);
+
+// Buffers, with AHardwareBuffer semantics. Functions returning int return 0 on success and a
+// negative errno value otherwise.
+
+int allocateBuffer(const AHardwareBuffer_Desc*, AHardwareBuffer**);
+
+// For the formats renderers allocate, 0 for any other
+inline uint32_t bytesPerPixel(uint32_t format)
+{
+    switch (format) {
+    case AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM:
+    case AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM:
+    case AHARDWAREBUFFER_FORMAT_R10G10B10A2_UNORM:
+        return 4;
+    case AHARDWAREBUFFER_FORMAT_R5G6B5_UNORM:
+        return 2;
+    case AHARDWAREBUFFER_FORMAT_R16G16B16A16_FLOAT:
+        return 8;
+    }
+    return 0;
+}
+
+void acquireBuffer(AHardwareBuffer*);
+void releaseBuffer(AHardwareBuffer*);
+void describeBuffer(const AHardwareBuffer*, AHardwareBuffer_Desc*);
+
+// Maps the whole buffer for CPU access once fence (owned by the callee, may be -1) has signaled
+int lockBuffer(AHardwareBuffer*, uint64_t usage, int fence, void** address);
+int unlockBuffer(AHardwareBuffer*);
+
+int sendBuffer(const AHardwareBuffer*, int socketFd);
+// -EPIPE when the buffer was only partly read and the socket cannot be read from anymore
+int receiveBuffer(int socketFd, AHardwareBuffer**);
+
+// EGL
+
+// Whether buffers can be imported as EGL images, renderers fall back to shared memory otherwise
+bool supportsBufferImport();
+EGLClientBuffer clientBuffer(AHardwareBuffer*);
+
+// Flushes pending rendering and returns a native fence fd signaling its completion, or -1
+int createNativeFence(EGLDisplay);
+
+} // namespace Platform
+
+} // namespace WPEAndroid
@@ -18,35 +18,25 @@
 
 #include "interfaces.h"
 
+#include <algorithm>
 #include <array>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
-#include <android/hardware_buffer.h>
 #include <cstdint>
 #include <errno.h>
+#include <unistd.h>
 #include <unordered_map>
-
+#include <vector>
 
 #include "ipc.h"
 #include "ipc-messages.h"
 #include "logging.h"
-
-struct Buffer {
-    uint32_t bufferID { 0 };
-    bool locked { false };
-    AHardwareBuffer* object { nullptr };
-
-    struct {
-        EGLImageKHR image { EGL_NO_IMAGE_KHR };
-    } egl;
-
-    struct {
-        GLuint colorBuffer { 0 };
-        GLuint dsBuffer { 0 };
-    } gl;
-};
+#include "platform.h"
+#include "renderer-buffer.h"
+#include "shared-memory.h"
+#include "trace.h"
 
 class EGLTarget;
 
@@ -57,94 +47,175 @@ public:
 
     IPC::Client& ipc() { return m_ipcClient; }
 
+    // Negotiated in the handshake, none until the UI process replies
+    bool hasCapability(IPC::Capability capability) const { return m_capabilities & capability; }
+
     void registerEGLTarget(uint32_t poolId, EGLTarget*);
     void unregisterEGLTarget(uint32_t poolId);
 
+    // Blocks until the UI process replies with the ID of the new pool, false on timeout
+    bool constructPool(uint32_t viewId, IPC::PoolConstructionReply&);
+
+    // Blocks until the UI process releases a buffer of the pool, false on timeout
+    bool waitForRelease(uint32_t poolId);
+
 private:
 
     // IPC::Client::Handle
     void handleMessage(char*, size_t) override;
 
+    // Handles the releases of a FrameFeedback right away and defers its frame completion
+    void handleReleases(IPC::FrameFeedback);
+
+    void scheduleDeferredMessages();
+
     IPC::Client m_ipcClient;
+    uint32_t m_capabilities { 0 };
 
     // (poolId -> EGLTarget)
     std::unordered_map<uint32_t, EGLTarget*> m_targetMap;
+
+    // Messages read while waiting for a release, handled later from the main loop so that
+    // frame completion is never dispatched from within frame_will_render
+    std::vector<IPC::Message> m_deferredMessages;
+    GSource* m_deferredMessagesSource { nullptr };
 };
 
-class EGLTarget : public IPC::Client::Handler {
+class EGLTarget {
 public:
     EGLTarget(struct wpe_renderer_backend_egl_target*, int);
     virtual ~EGLTarget();
 
     void initialize(RendererBackend* backend, uint32_t width, uint32_t height);
     void resize(uint32_t width, uint32_t height);
+    void setFormat(const IPC::PoolFormat&);
+    void setVisible(bool);
+    // Parks the buffers the UI process gave back while the view is hidden
+    void requestPark();
 
     void frameWillRender();
     void frameRendered();
+    void frameComplete(const IPC::FrameFeedback&);
 
     void deinitialize();
 
     void releaseBuffer(uint32_t, uint32_t);
 
-    // IPC::Client::Handle
-    void handleMessage(char*, size_t) override;
+    Buffer* availableBuffer();
+    // Allocates the buffer and, once it can be rendered to, sends it to the UI process
+    bool allocateBuffer(Buffer&);
+    bool allocateHardwareBuffer(Buffer&);
+    bool allocateSharedMemoryBuffer(Buffer&);
+    void sendBufferAllocation(Buffer&);
+
+    int64_t lockedBuffers() const;
 
     struct wpe_renderer_backend_egl_target* target;
 
     RendererBackend* m_backend { nullptr };
 
-    IPC::Client ipcClient;
+    // Received through the socket libwpe creates for the target, which is closed right away
+    uint32_t viewID { 0 };
 
     struct {
         bool initialized { false };
+        bool sharedMemory { false };
         uint32_t width { 0 };
         uint32_t height { 0 };
 
-        PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC getNativeClientBufferANDROID;
-        PFNEGLCREATEIMAGEKHRPROC createImageKHR;
-        PFNEGLDESTROYIMAGEKHRPROC destroyImageKHR;
-        PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC imageTargetRenderbufferStorageOES;
-        PFNEGLCREATESYNCKHRPROC createSyncKHR;
-        PFNEGLDESTROYSYNCKHRPROC destroySyncKHR;
-        PFNEGLDUPNATIVEFENCEFDANDROIDPROC dupNativeFenceFDANDROID;
+        // Sent to the UI process along with each commit
+        uint32_t starvationEvents { 0 };
+        gint64 starvationMicroseconds { 0 };
 
-        GLuint framebuffer { 0 };
+        // What WebKit renders with, as of the last frameWillRender(), to park and rewarm buffers
+        // between frames
+        EGLDisplay display { EGL_NO_DISPLAY };
+        EGLContext context { EGL_NO_CONTEXT };
+        EGLSurface drawSurface { EGL_NO_SURFACE };
+        EGLSurface readSurface { EGL_NO_SURFACE };
+
+        BufferEntryPoints entryPoints;
     } renderer;
 
     struct {
         Buffer* current { nullptr };
 
         uint32_t poolID { 0 };
+        uint32_t frameID { 0 };
         std::array<Buffer, 4> pool;
+
+        // As wanted by the view, 0 for the defaults
+        uint32_t format { 0 };
+        uint64_t usage { 0 };
+        bool opaque { false };
+        bool purgeRequested { false };
     } buffers;
-};
 
-static void destroyBufferPool(std::array<Buffer, 4>& pool, PFNEGLDESTROYIMAGEKHRPROC destroyImageKHR)
-{
-    for (auto& buffer : pool) {
-        if (buffer.gl.colorBuffer)
-            glDeleteRenderbuffers(1, &buffer.gl.colorBuffer);
-        if (buffer.gl.dsBuffer)
-            glDeleteRenderbuffers(1, &buffer.gl.dsBuffer);
-        buffer.gl = { };
+    // libwpe has no way to hand the next deadline to WebKit, so frame completion is held back
+    // until WebKit has just enough time left to render before it
+    struct {
+        GSource* source { nullptr };
+        uint32_t frameID { 0 };
 
-        if (buffer.egl.image)
-            destroyImageKHR(eglGetCurrentDisplay(), buffer.egl.image);
-        buffer.egl = { };
+        // Slowly decaying peak of the time from frame completion to the next frameRendered()
+        gint64 renderTime { 0 };
+        gint64 dispatchTime { 0 };
 
-        if (buffer.object)
-            AHardwareBuffer_release(buffer.object);
+        // Deadline the frame pacedFrameID is rendered for, 0 once it has been presented
+        gint64 deadline { 0 };
+        uint32_t pacedFrameID { 0 };
+        uint32_t backoff { 0 };
+    } pacing;
 
-        buffer.locked = false;
-        buffer.object = nullptr;
-    }
-}
+    // Hidden views are not displayed, they only need to keep WebKit going and hold on to the
+    // buffers the UI process still has
+    struct {
+        bool hidden { false };
+        gint64 lastFrameComplete { 0 };
+
+        // Freed while hidden, allocated again ahead of the first frame once shown. WebKit stops
+        // rendering hidden views, so both are done from an idle source on the rendering thread,
+        // or from frameWillRender() if that comes first.
+        uint32_t parkedBuffers { 0 };
+        bool parkRequested { false };
+        bool rewarmRequested { false };
+        GSource* source { nullptr };
+    } visibility;
+
+private:
+    void scheduleFrameComplete(gint64 readyTime);
+    void dispatchFrameComplete();
+
+    // Frees the buffers the UI process does not hold, except the one about to be rendered to
+    void parkBuffers();
+    void rewarmBuffers();
+    void scheduleVisibilityChange();
+    // Parks or rewarms with the context of the last frame made current for a moment
+    void applyVisibilityChange();
+
+    uint32_t hardwareBufferFormat() const;
+    // Drops every buffer, including the ones held by the UI process
+    void purgePool();
+};
 
 RendererBackend::RendererBackend(int fd) {
     m_ipcClient.initialize(*this, fd);
+
+    // The reply comes ahead of the one to the first PoolConstruction
+    IPC::Handshake handshake = { };
+    handshake.protocolVersion = IPC::protocolVersion;
+    handshake.capabilities = IPC::supportedCapabilities;
+
+    IPC::Message message;
+    IPC::Handshake::construct(message, handshake);
+    m_ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
 RendererBackend::~RendererBackend() {
+    if (m_deferredMessagesSource) {
+        g_source_destroy(m_deferredMessagesSource);
+        g_source_unref(m_deferredMessagesSource);
+    }
     m_ipcClient.deinitialize();
 }
 
@@ -159,39 +230,165 @@ void RendererBackend::unregisterEGLTarget(uint32_t poolId) {
     }
 }
 
+// Long enough for any UI process that is still alive
+static const gint64 s_replyTimeout = 2 * G_USEC_PER_SEC;
+// Starvation is fatal past it, the UI process holding on to every buffer for that long is gone
+static const gint64 s_releaseTimeout = 2 * G_USEC_PER_SEC;
+
+bool RendererBackend::constructPool(uint32_t viewId, IPC::PoolConstructionReply& reply) {
+    IPC::PoolConstruction poolConstruction = { };
+    poolConstruction.viewID = viewId;
+
+    IPC::Message message;
+    IPC::PoolConstruction::construct(message, poolConstruction);
+    m_ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+
+    // Traffic of the other targets of the WebProcess may come first. Releases are handled right
+    // away, as waitForRelease() would not see them in the deferred messages.
+    gint64 deadline = g_get_monotonic_time() + s_replyTimeout;
+    bool constructed = false;
+    while (!constructed) {
+        gint64 remaining = deadline - g_get_monotonic_time();
+        IPC::Message message;
+        if (remaining <= 0 || !m_ipcClient.receiveMessage(IPC::Message::data(message), IPC::Message::size, remaining))
+            break;
+
+        if (message.messageCode == IPC::PoolConstructionReply::code) {
+            reply = IPC::PoolConstructionReply::from(message);
+            constructed = true;
+        } else if (message.messageCode == IPC::FrameFeedback::code)
+            handleReleases(IPC::FrameFeedback::from(message));
+        else if (message.messageCode == IPC::HandshakeReply::code)
+            handleMessage(IPC::Message::data(message), IPC::Message::size);
+        else
+            m_deferredMessages.push_back(message);
+    }
+
+    scheduleDeferredMessages();
+    return constructed;
+}
+
+bool RendererBackend::waitForRelease(uint32_t poolId) {
+    gint64 deadline = g_get_monotonic_time() + s_releaseTimeout;
+    bool released = false;
+    while (!released) {
+        gint64 remaining = deadline - g_get_monotonic_time();
+        IPC::Message message;
+        if (remaining <= 0 || !m_ipcClient.receiveMessage(IPC::Message::data(message), IPC::Message::size, remaining))
+            break;
+
+        if (message.messageCode != IPC::FrameFeedback::code) {
+            m_deferredMessages.push_back(message);
+            continue;
+        }
+
+        auto feedback = IPC::FrameFeedback::from(message);
+        handleReleases(feedback);
+        released = feedback.poolID == poolId && feedback.releasedBuffers;
+    }
+
+    scheduleDeferredMessages();
+    return released;
+}
+
+void RendererBackend::handleReleases(IPC::FrameFeedback feedback) {
+    if (feedback.frameComplete) {
+        auto frameComplete = feedback;
+        frameComplete.releasedBuffers = 0;
+
+        IPC::Message deferred;
+        IPC::FrameFeedback::construct(deferred, frameComplete);
+        m_deferredMessages.push_back(deferred);
+    }
+
+    if (!feedback.releasedBuffers)
+        return;
+
+    feedback.frameComplete = 0;
+    IPC::Message releases;
+    IPC::FrameFeedback::construct(releases, feedback);
+    handleMessage(IPC::Message::data(releases), IPC::Message::size);
+}
+
+void RendererBackend::scheduleDeferredMessages() {
+    if (m_deferredMessages.empty() || m_deferredMessagesSource)
+        return;
+
+    m_deferredMessagesSource = g_idle_source_new();
+    g_source_set_priority(m_deferredMessagesSource, G_PRIORITY_DEFAULT);
+    g_source_set_callback(m_deferredMessagesSource, [](gpointer data) -> gboolean {
+        auto& backend = *static_cast<RendererBackend*>(data);
+        g_source_unref(backend.m_deferredMessagesSource);
+        backend.m_deferredMessagesSource = nullptr;
+
+        auto messages = std::move(backend.m_deferredMessages);
+        backend.m_deferredMessages.clear();
+        for (auto& message : messages)
+            backend.handleMessage(IPC::Message::data(message), IPC::Message::size);
+        return G_SOURCE_REMOVE;
+    }, this, nullptr);
+    g_source_attach(m_deferredMessagesSource, g_main_context_get_thread_default());
+}
+
 void RendererBackend::handleMessage(char* data, size_t size) {
     if (size != IPC::Message::size)
         return;
 
     auto& message = IPC::Message::cast(data);
     switch (message.messageCode) {
-    case IPC::FrameComplete::code:
-    {   auto frameComplete = IPC::FrameComplete::from(message);
-        ALOGV("RendererBackend::handleMessage(): FrameComplete { poolID %u }", frameComplete.poolID);
-        auto it = m_targetMap.find(frameComplete.poolID);
-        if (it == m_targetMap.end()) {
-            // This situation can happen if during intensive rendering page is destroyed while frame is still
-            // being processed by UIProcess. This used to be g_error but we must not crash in such situation.
-            g_warning("RendererBackend - Cannot find buffer pool with poolId %" PRIu32 " in renderer backend.", frameComplete.poolID);
-            return;
-        }
-
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(it->second->target);
+    case IPC::HandshakeReply::code:
+    {
+        auto reply = IPC::HandshakeReply::from(message);
+        if (reply.protocolVersion == IPC::protocolVersion)
+            m_capabilities = reply.capabilities & IPC::supportedCapabilities;
+        else
+            ALOGE("RendererBackend: UI process speaks protocol version %u instead of %u and disconnects, nothing will be rendered",
+                reply.protocolVersion, IPC::protocolVersion);
+        ALOGD("RendererBackend::handleMessage(): HandshakeReply, capabilities %#x", m_capabilities);
         break;
     }
-    case IPC::ReleaseBuffer::code:
+    case IPC::PoolFormat::code:
     {
-        auto release = IPC::ReleaseBuffer::from(message);
-        ALOGV("RendererBackend::handleMessage(): BufferRelease { poolID %u, bufferID %u }", release.poolID, release.bufferID);
-        auto it = m_targetMap.find(release.poolID);
+        auto format = IPC::PoolFormat::from(message);
+        auto it = m_targetMap.find(format.poolID);
+        if (it != m_targetMap.end())
+            it->second->setFormat(format);
+        break;
+    }
+    case IPC::PoolVisibility::code:
+    {
+        auto visibility = IPC::PoolVisibility::from(message);
+        auto it = m_targetMap.find(visibility.poolID);
+        if (it != m_targetMap.end())
+            it->second->setVisible(visibility.visible);
+        break;
+    }
+    case IPC::FrameFeedback::code:
+    {
+        auto feedback = IPC::FrameFeedback::from(message);
+        ALOGV("RendererBackend::handleMessage(): FrameFeedback { poolID %u, releasedBuffers %#x, frameComplete %u }",
+            feedback.poolID, feedback.releasedBuffers, feedback.frameComplete);
+        auto it = m_targetMap.find(feedback.poolID);
         if (it == m_targetMap.end()) {
             // This situation can happen if during intensive rendering page is destroyed while frame is still
             // being processed by UIProcess. This used to be g_error but we must not crash in such situation.
-            g_warning("RendererBackend - Cannot find buffer pool with poolId %" PRIu32 " in renderer backend.", release.poolID);
+            g_warning("RendererBackend - Cannot find buffer pool with poolId %" PRIu32 " in renderer backend.", feedback.poolID);
+            IPC::FlightRecorder::dumpAllOnAnomaly("FrameFeedback for an unknown pool");
             return;
         }
 
-        it->second->releaseBuffer(release.poolID, release.bufferID);
+        // Buffers come back first, so that the frame WebKit renders on completion has one
+        for (uint32_t bufferID = 0; feedback.releasedBuffers >> bufferID; ++bufferID) {
+            if (feedback.releasedBuffers & (1 << bufferID))
+                it->second->releaseBuffer(feedback.poolID, bufferID);
+        }
+
+        // Hidden views give their buffers up as soon as they come back
+        if (feedback.releasedBuffers && it->second->visibility.hidden)
+            it->second->requestPark();
+
+        if (feedback.frameComplete)
+            it->second->frameComplete(feedback);
         break;
     }
     default:
@@ -203,7 +400,12 @@ void RendererBackend::handleMessage(char* data, size_t size) {
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
 {
-    ipcClient.initialize(*this, hostFd);
+    IPC::Message message;
+    if (IPC::readMessageSocket(hostFd, IPC::Message::data(message), IPC::Message::size)
+        && message.messageCode == IPC::ViewIdentity::code)
+        viewID = IPC::ViewIdentity::from(message).viewID;
+    else
+        ALOGE("EGLTarget: no view identity received, frames will not be displayed");
 
     for (auto& buffer : buffers.pool)
         buffer.bufferID = uint32_t(std::distance(buffers.pool.begin(), &buffer));
@@ -211,19 +413,30 @@ EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
 
 EGLTarget::~EGLTarget()
 {
-    IPC::UnregisterPool unregisterPool;
-    unregisterPool.poolID = buffers.poolID;
+    if (pacing.source) {
+        g_source_destroy(pacing.source);
+        g_source_unref(pacing.source);
+    }
+    if (visibility.source) {
+        g_source_destroy(visibility.source);
+        g_source_unref(visibility.source);
+    }
 
-    IPC::Message message;
-    IPC::UnregisterPool::construct(message, unregisterPool);
-    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    if (m_backend) {
+        IPC::UnregisterPool unregisterPool = { };
+        unregisterPool.poolID = buffers.poolID;
 
-    ipcClient.deinitialize();
+        IPC::Message message;
+        IPC::UnregisterPool::construct(message, unregisterPool);
+        m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
+
+        m_backend->unregisterEGLTarget(buffers.poolID);
+    }
 
-    m_backend->unregisterEGLTarget(buffers.poolID);
     for (auto& buffer : buffers.pool) {
         if (buffer.object)
-            AHardwareBuffer_release(buffer.object);
+            WPEAndroid::Platform::releaseBuffer(buffer.object);
+        buffer.shm.release();
     }
 }
 
@@ -234,49 +447,200 @@ void EGLTarget::initialize(RendererBackend* backend, uint32_t width, uint32_t he
     renderer.width = width;
     renderer.height = height;
 
-    IPC::PoolConstruction poolConstruction;
+    // The UI process registers the pool with the view, so commits that follow are never dropped
+    IPC::PoolConstructionReply reply = { };
+    if (!backend->constructPool(viewID, reply)) {
+        ALOGE("EGLTarget: no pool constructed by the UI process");
+        IPC::FlightRecorder::dumpAll("pool construction");
+        std::abort();
+        return;
+    }
+    buffers.poolID = reply.poolID;
+    if (m_backend->hasCapability(IPC::CapabilityBufferFormats)) {
+        buffers.format = reply.format;
+        buffers.usage = reply.usage;
+        buffers.opaque = reply.opaque;
+    }
+    if (m_backend->hasCapability(IPC::CapabilityVisibility))
+        visibility.hidden = reply.hidden;
+    ALOGV("  PoolConstructionReply: poolID %u, format %u, usage %#" PRIx64 ", opaque %d, hidden %d",
+        buffers.poolID, buffers.format, buffers.usage, buffers.opaque, visibility.hidden);
 
-    IPC::Message message;
-    IPC::PoolConstruction::construct(message, poolConstruction);
+    m_backend->registerEGLTarget(buffers.poolID, this);
+}
 
-    // We can safely assume that returned message is PoolConstructionReply because there are no
-    // other messages coming this way in this socket at this point
-    backend->ipc().sendAndReceiveMessage(IPC::Message::data(message), IPC::Message::size, [&] (char* data, size_t size) {
-        ALOGV("EGLTarget::initialize - handleMessage() %p[%zu]", data, size);
-        if (size != IPC::Message::size)
-            return;
+void EGLTarget::resize(uint32_t width, uint32_t height)
+{
+    if (renderer.width == width && renderer.height == height)
+        return;
+    ALOGV("EGLTarget::resize() (%u,%u)", width, height);
+    renderer.width = width;
+    renderer.height = height;
 
-        auto& message = IPC::Message::cast(data);
-        switch (message.messageCode) {
-            case IPC::PoolConstructionReply::code:
-            {
-                auto reply = IPC::PoolConstructionReply::from(message);
-                ALOGV("  PoolConstructionReply: poolID %u", reply.poolID);
+    purgePool();
+}
 
-                buffers.poolID = reply.poolID;
+void EGLTarget::setFormat(const IPC::PoolFormat& format)
+{
+    if (format.format == buffers.format && format.usage == buffers.usage && !!format.opaque == buffers.opaque)
+        return;
+    ALOGV("EGLTarget::setFormat() format %u, usage %#" PRIx64 ", opaque %u", format.format, format.usage, format.opaque);
+    buffers.format = format.format;
+    buffers.usage = format.usage;
+    buffers.opaque = format.opaque;
 
-                m_backend->registerEGLTarget(buffers.poolID, this);
+    // Only done from frameWillRender(), where the context of the buffers is current
+    buffers.purgeRequested = true;
+}
 
-                IPC::RegisterPool registerPool;
-                registerPool.poolID = reply.poolID;
+void EGLTarget::setVisible(bool visible)
+{
+    if (visible == !visibility.hidden)
+        return;
+    ALOGV("EGLTarget::setVisible() %d", visible);
+    visibility.hidden = !visible;
+
+    if (!visible) {
+        // Nothing is presented, so there is no deadline to render for
+        pacing.deadline = 0;
+        visibility.rewarmRequested = false;
+        requestPark();
+        return;
+    }
 
-                IPC::Message message;
-                IPC::RegisterPool::construct(message, registerPool);
-                ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
-            }
-        }
-    });
+    visibility.parkRequested = false;
+    visibility.rewarmRequested = !!visibility.parkedBuffers;
+    if (visibility.rewarmRequested)
+        scheduleVisibilityChange();
+
+    // A frame completion held back while hidden goes out right away
+    if (pacing.source && g_source_get_ready_time(pacing.source) != -1) {
+        g_source_set_ready_time(pacing.source, -1);
+        dispatchFrameComplete();
+    }
 }
 
-void EGLTarget::resize(uint32_t width, uint32_t height)
+void EGLTarget::requestPark()
 {
-    if (renderer.width == width && renderer.height == height)
+    visibility.parkRequested = true;
+    scheduleVisibilityChange();
+}
+
+void EGLTarget::scheduleVisibilityChange()
+{
+    if (visibility.source)
         return;
-    ALOGV("EGLTarget::resize() (%u,%u)", width, height);
-    renderer.width = width;
-    renderer.height = height;
 
-    destroyBufferPool(buffers.pool, renderer.destroyImageKHR);
+    visibility.source = g_idle_source_new();
+    g_source_set_priority(visibility.source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(visibility.source, [](gpointer data) -> gboolean {
+        auto& target = *static_cast<EGLTarget*>(data);
+        g_source_unref(target.visibility.source);
+        target.visibility.source = nullptr;
+
+        target.applyVisibilityChange();
+        return G_SOURCE_REMOVE;
+    }, this, nullptr);
+    g_source_attach(visibility.source, g_main_context_get_thread_default());
+}
+
+void EGLTarget::applyVisibilityChange()
+{
+    if (!visibility.parkRequested && !visibility.rewarmRequested)
+        return;
+    // Nothing was allocated before the first frame
+    if (renderer.context == EGL_NO_CONTEXT)
+        return;
+
+    // WebKit may have left any context current. Making ours current fails if another thread has
+    // it, and then frameWillRender() does the work instead.
+    EGLDisplay previousDisplay = eglGetCurrentDisplay();
+    EGLContext previousContext = eglGetCurrentContext();
+    EGLSurface previousDrawSurface = eglGetCurrentSurface(EGL_DRAW);
+    EGLSurface previousReadSurface = eglGetCurrentSurface(EGL_READ);
+    bool switchContext = previousContext != renderer.context;
+    if (switchContext && !eglMakeCurrent(renderer.display, renderer.drawSurface, renderer.readSurface, renderer.context)) {
+        ALOGV("EGLTarget: cannot make the context of the buffers current: %#x", eglGetError());
+        return;
+    }
+
+    // Allocation binds the new framebuffer, WebKit finds its own bindings as it left them
+    GLint framebuffer = 0;
+    GLint renderbuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer);
+
+    if (visibility.parkRequested)
+        parkBuffers();
+    else
+        rewarmBuffers();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, glIsFramebuffer(framebuffer) ? framebuffer : 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, glIsRenderbuffer(renderbuffer) ? renderbuffer : 0);
+
+    if (!switchContext)
+        return;
+    if (previousContext != EGL_NO_CONTEXT)
+        eglMakeCurrent(previousDisplay, previousDrawSurface, previousReadSurface, previousContext);
+    else
+        eglMakeCurrent(renderer.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void EGLTarget::parkBuffers()
+{
+    WPE_TRACE_SCOPE("EGLTarget::parkBuffers");
+    visibility.parkRequested = false;
+
+    uint32_t parkedBuffers = 0;
+    for (auto& buffer : buffers.pool) {
+        if (buffer.locked || &buffer == buffers.current || (!buffer.object && !buffer.shm.data()))
+            continue;
+
+        destroyBuffer(buffer, renderer.entryPoints);
+        parkedBuffers |= 1 << buffer.bufferID;
+    }
+    if (!parkedBuffers)
+        return;
+
+    ALOGV("EGLTarget::parkBuffers() %#x", parkedBuffers);
+    visibility.parkedBuffers |= parkedBuffers;
+
+    IPC::PoolPark poolPark = { };
+    poolPark.poolID = buffers.poolID;
+    poolPark.parkedBuffers = parkedBuffers;
+
+    IPC::Message message;
+    IPC::PoolPark::construct(message, poolPark);
+    m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
+void EGLTarget::rewarmBuffers()
+{
+    WPE_TRACE_SCOPE("EGLTarget::rewarmBuffers");
+
+    uint32_t parkedBuffers = visibility.parkedBuffers;
+    visibility.parkedBuffers = 0;
+    visibility.rewarmRequested = false;
+
+    // The ones that cannot be allocated here are on the first frames that need them
+    for (auto& buffer : buffers.pool) {
+        if ((parkedBuffers & (1 << buffer.bufferID)) && !buffer.locked && !buffer.object && !buffer.shm.data())
+            allocateBuffer(buffer);
+    }
+}
+
+uint32_t EGLTarget::hardwareBufferFormat() const
+{
+    if (buffers.format && buffers.format != s_bufferFormat)
+        return buffers.format;
+    return buffers.opaque ? AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM : s_bufferFormat;
+}
+
+void EGLTarget::purgePool()
+{
+    destroyBufferPool(buffers.pool, renderer.entryPoints);
+    visibility.parkedBuffers = 0;
+    visibility.rewarmRequested = false;
 
     IPC::PoolPurge poolPurge;
     poolPurge.poolID = buffers.poolID;
@@ -288,145 +652,349 @@ void EGLTarget::resize(uint32_t width, uint32_t height)
 
 void EGLTarget::frameWillRender()
 {
+    WPEAndroid::Trace::refresh();
+    WPE_TRACE_SCOPE("EGLTarget::frameWillRender");
+
+    renderer.display = eglGetCurrentDisplay();
+    renderer.context = eglGetCurrentContext();
+    renderer.drawSurface = eglGetCurrentSurface(EGL_DRAW);
+    renderer.readSurface = eglGetCurrentSurface(EGL_READ);
+
     if (!renderer.initialized) {
         renderer.initialized = true;
 
-        renderer.getNativeClientBufferANDROID = reinterpret_cast<PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC>(
-            eglGetProcAddress("eglGetNativeClientBufferANDROID"));
-        renderer.createImageKHR = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
-            eglGetProcAddress("eglCreateImageKHR"));
-        renderer.destroyImageKHR = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
-            eglGetProcAddress("eglDestroyImageKHR"));
-        renderer.imageTargetRenderbufferStorageOES = reinterpret_cast<PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC>(
-            eglGetProcAddress("glEGLImageTargetRenderbufferStorageOES"));
-        renderer.createSyncKHR = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(
-            eglGetProcAddress("eglCreateSyncKHR"));
-        renderer.destroySyncKHR = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(
-            eglGetProcAddress("eglDestroySyncKHR"));
-        renderer.dupNativeFenceFDANDROID = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(
-            eglGetProcAddress("eglDupNativeFenceFDANDROID"));
-
-        GLuint framebuffer { 0 };
-        glGenFramebuffers(1, &framebuffer);
-        renderer.framebuffer = framebuffer;
-
-        ALOGV("  initialized, entrypoints %p/%p/%p/%p, framebuffer %u",
-            renderer.getNativeClientBufferANDROID, renderer.createImageKHR, renderer.destroyImageKHR, renderer.imageTargetRenderbufferStorageOES,
-            renderer.framebuffer);
-    }
+        renderer.entryPoints.resolve();
 
-    for (auto& buffer : buffers.pool) {
-        if (buffer.locked)
-            continue;
+        // Shared memory buffers are used for headless and software rendering, where the consumer
+        // needs the pixels on the CPU, and whenever hardware buffers cannot be imported into EGL.
+        bool canImportBuffers = renderer.entryPoints.canImportBuffers();
+        renderer.sharedMemory = m_backend->hasCapability(IPC::CapabilitySharedMemoryBuffers)
+            && (!!g_getenv("WPE_ANDROID_SHARED_MEMORY_BUFFERS") || !canImportBuffers);
+        if (!canImportBuffers && !renderer.sharedMemory)
+            ALOGE("EGLTarget: buffers can neither be imported nor shared with the UI process");
 
-        buffers.current = &buffer;
-        break;
+        ALOGV("  initialized, entrypoints %p/%p/%p, shared memory %d",
+            renderer.entryPoints.createImageKHR, renderer.entryPoints.destroyImageKHR,
+            renderer.entryPoints.imageTargetRenderbufferStorageOES, renderer.sharedMemory);
+    }
+    if (buffers.purgeRequested) {
+        buffers.purgeRequested = false;
+        purgePool();
+    }
+
+    buffers.current = availableBuffer();
+    if (!buffers.current) {
+        // Every buffer is held by the UI process, wait for one to come back as a blocking
+        // dequeue would
+        WPE_TRACE_SCOPE("EGLTarget::waitForRelease");
+        ALOGV("  no available current-buffer found, waiting for a release");
+        renderer.starvationEvents++;
+
+        gint64 start = g_get_monotonic_time();
+        while (!buffers.current && m_backend->waitForRelease(buffers.poolID))
+            buffers.current = availableBuffer();
+        renderer.starvationMicroseconds += g_get_monotonic_time() - start;
     }
     if (!buffers.current) {
-        ALOGV("  no available current-buffer found");
+        ALOGE("EGLTarget: no buffer released by the UI process");
+        IPC::FlightRecorder::dumpAll("buffer starvation");
         std::abort();
         return;
     }
 
     auto& current = *buffers.current;
 
-    if (!current.object) {
-        AHardwareBuffer_Desc description;
-        description.width = renderer.width;
-        description.height = renderer.height;
-        description.layers = 1;
-        description.format = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
-        description.usage = AHARDWAREBUFFER_USAGE_GPU_FRAMEBUFFER | AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE | AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY;
-        description.stride = description.rfu0 = description.rfu1 = 0;
-
-        int ret = AHardwareBuffer_allocate(&description, &current.object);
-        if (!!ret || !current.object) {
-            ALOGV("  failed to allocate AHardwareBuffer: ret %d", ret);
-            return;
-        }
+    if (!current.object && !current.shm.data() && !allocateBuffer(current))
+        return;
 
-        EGLClientBuffer clientBuffer = renderer.getNativeClientBufferANDROID(current.object);
-        current.egl.image = renderer.createImageKHR(eglGetCurrentDisplay(),
-            EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, clientBuffer, nullptr);
+    // Once the buffer to render into is known, the others can go or come back. The framebuffer
+    // of the current buffer is bound right after.
+    if (visibility.parkRequested)
+        parkBuffers();
+    else if (visibility.rewarmRequested)
+        rewarmBuffers();
 
-        std::array<GLuint, 2> renderbuffers { 0, 0 };
-        glGenRenderbuffers(2, renderbuffers.data());
-        current.gl.colorBuffer = renderbuffers[0];
-        current.gl.dsBuffer = renderbuffers[1];
+    glBindFramebuffer(GL_FRAMEBUFFER, current.gl.framebuffer);
 
-        glBindRenderbuffer(GL_RENDERBUFFER, current.gl.colorBuffer);
-        renderer.imageTargetRenderbufferStorageOES(GL_RENDERBUFFER, current.egl.image);
+#if !LOG_NDEBUG
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        ALOGV("EGLTarget: GL_FRAMEBUFFER not COMPLETE");
+#endif
+}
 
-        glBindRenderbuffer(GL_RENDERBUFFER, current.gl.dsBuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8_OES, renderer.width, renderer.height);
+Buffer* EGLTarget::availableBuffer()
+{
+    // Buffers already allocated go first, the pool only grows when all of them are held
+    Buffer* available = nullptr;
+    for (auto& buffer : buffers.pool) {
+        if (buffer.locked)
+            continue;
+        if (buffer.object || buffer.shm.data())
+            return &buffer;
+        if (!available)
+            available = &buffer;
+    }
+    return available;
+}
 
-        {
-            IPC::BufferAllocation allocation;
-            allocation.poolID = buffers.poolID;
-            allocation.bufferID = current.bufferID;
+bool EGLTarget::allocateBuffer(Buffer& buffer)
+{
+    auto colorStorage = [this](Buffer& buffer) {
+        return renderer.sharedMemory ? allocateSharedMemoryBuffer(buffer) : allocateHardwareBuffer(buffer);
+    };
+
+    // Formats and usages the view asks for may be impossible to allocate, import or render to
+    bool allocated = createBufferFramebuffer(buffer, renderer.width, renderer.height, renderer.entryPoints, colorStorage);
+    if (!allocated && !renderer.sharedMemory && (buffers.format || buffers.usage)) {
+        ALOGW("EGLTarget: cannot render into buffers of format %u and usage %#" PRIx64 ", using the defaults",
+            buffers.format, buffers.usage);
+        buffers.format = 0;
+        buffers.usage = 0;
+        allocated = createBufferFramebuffer(buffer, renderer.width, renderer.height, renderer.entryPoints, colorStorage);
+    }
+    if (!allocated)
+        return false;
 
-            IPC::Message message;
-            IPC::BufferAllocation::construct(message, allocation);
-            m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
+    sendBufferAllocation(buffer);
+    return true;
+}
+
+bool EGLTarget::allocateHardwareBuffer(Buffer& buffer)
+{
+    WPE_TRACE_SCOPE("EGLTarget::allocateHardwareBuffer");
+
+    AHardwareBuffer_Desc description;
+    description.width = renderer.width;
+    description.height = renderer.height;
+    description.layers = 1;
+    description.format = hardwareBufferFormat();
+    // CPU reads are rare (snapshots), they only need to be possible. Overlays are only worth
+    // asking for when the view did not say how its buffers are used.
+    description.usage = s_bufferUsage | AHARDWAREBUFFER_USAGE_CPU_READ_RARELY
+        | (buffers.usage ? buffers.usage : AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY);
+    description.stride = description.rfu0 = description.rfu1 = 0;
+
+    return importHardwareBuffer(buffer, description, renderer.entryPoints);
+}
+
+bool EGLTarget::allocateSharedMemoryBuffer(Buffer& buffer)
+{
+    WPE_TRACE_SCOPE("EGLTarget::allocateSharedMemoryBuffer");
+
+    // Tightly packed RGBA rows, which is what glReadPixels() produces with the default pack alignment
+    uint32_t stride = renderer.width * 4;
+    if (!buffer.shm.allocate(size_t(stride) * renderer.height))
+        return false;
+    buffer.stride = stride;
+
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8_OES, renderer.width, renderer.height);
+    return true;
+}
+
+void EGLTarget::sendBufferAllocation(Buffer& buffer)
+{
+    if (buffer.shm.data()) {
+        IPC::SharedMemoryBufferAllocation allocation;
+        allocation.poolID = buffers.poolID;
+        allocation.bufferID = buffer.bufferID;
+        allocation.width = renderer.width;
+        allocation.height = renderer.height;
+        allocation.stride = buffer.stride;
+        // Read back as RGBA whatever the view asked for, only opacity carries over
+        allocation.format = buffers.opaque ? AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM : s_bufferFormat;
+
+        IPC::Message message;
+        IPC::SharedMemoryBufferAllocation::construct(message, allocation);
+        m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
+        m_backend->ipc().sendFileDescriptor(buffer.shm.fd());
+        return;
+    }
+
+    IPC::BufferAllocation allocation = { };
+    allocation.poolID = buffers.poolID;
+    allocation.bufferID = buffer.bufferID;
+    allocation.opaque = buffers.opaque;
+
+    IPC::Message message;
+    IPC::BufferAllocation::construct(message, allocation);
+    m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
+
+    while (true) {
+        int ret = WPEAndroid::Platform::sendBuffer(buffer.object, m_backend->ipc().socketFd());
+        if (!ret || ret != -EAGAIN)
+            break;
+    }
+}
+
+int64_t EGLTarget::lockedBuffers() const
+{
+    return std::count_if(buffers.pool.begin(), buffers.pool.end(), [](const Buffer& buffer) { return buffer.locked; });
+}
+
+void EGLTarget::frameComplete(const IPC::FrameFeedback& feedback)
+{
+    // Margin for the wakeup and for the commit to reach the UI process
+    static const gint64 deadlineMargin = 4000;
+    // Frames rendered right away after a paced frame missed its deadline
+    static const uint32_t missBackoff = 10;
+    // Frame completion rate of hidden views
+    static const gint64 hiddenFrameInterval = G_USEC_PER_SEC;
+
+    // A paced frame presented later than the deadline it was rendered for gained nothing by
+    // waiting, such as with a consumer that holds frames for longer than a vsync
+    if (pacing.deadline && feedback.frameID >= pacing.pacedFrameID) {
+        if (feedback.presentationTime > pacing.deadline + feedback.nextDeadlineOffset / 2) {
+            ALOGV("EGLTarget::frameComplete(): frame %u missed its deadline by %" PRId64 "us",
+                feedback.frameID, feedback.presentationTime - pacing.deadline);
+            pacing.backoff = missBackoff;
+        }
+        pacing.deadline = 0;
+    }
+
+    pacing.frameID = feedback.frameID;
+    if (visibility.hidden) {
+        // Enough for the timers and animations of the page to go on, the UI process holds on
+        // to what it was shown last anyway
+        scheduleFrameComplete(visibility.lastFrameComplete + hiddenFrameInterval);
+        return;
+    }
 
-            while (true) {
-                int ret = AHardwareBuffer_sendHandleToUnixSocket(current.object, m_backend->ipc().socketFd());
-                if (!ret || ret != -EAGAIN)
-                    break;
-            }
+    if (pacing.backoff)
+        pacing.backoff--;
+    else if (m_backend->hasCapability(IPC::CapabilityFrameTiming) && feedback.nextDeadlineOffset
+        && feedback.presentationTime && pacing.renderTime) {
+        gint64 deadline = feedback.presentationTime + feedback.nextDeadlineOffset;
+        gint64 readyTime = deadline - pacing.renderTime - deadlineMargin;
+        if (readyTime > g_get_monotonic_time()) {
+            pacing.deadline = deadline;
+            pacing.pacedFrameID = buffers.frameID + 1;
+            scheduleFrameComplete(readyTime);
+            return;
         }
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, renderer.framebuffer);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, current.gl.colorBuffer);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, current.gl.dsBuffer);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, current.gl.dsBuffer);
+    scheduleFrameComplete(0);
+}
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        ALOGV("EGLTarget: GL_FRAMEBUFFER not COMPLETE");
+void EGLTarget::scheduleFrameComplete(gint64 readyTime)
+{
+    if (readyTime <= g_get_monotonic_time()) {
+        if (pacing.source)
+            g_source_set_ready_time(pacing.source, -1);
+        dispatchFrameComplete();
+        return;
+    }
+
+    if (!pacing.source) {
+        static GSourceFuncs sourceFuncs = {
+            nullptr, nullptr,
+            [](GSource* source, GSourceFunc callback, gpointer userData) -> gboolean {
+                g_source_set_ready_time(source, -1);
+                return callback(userData);
+            },
+            nullptr, nullptr, nullptr,
+        };
+        pacing.source = g_source_new(&sourceFuncs, sizeof(GSource));
+        g_source_set_name(pacing.source, "WPEBackend-android::frame-complete");
+        g_source_set_priority(pacing.source, G_PRIORITY_DEFAULT);
+        g_source_set_callback(pacing.source, [](gpointer data) -> gboolean {
+            static_cast<EGLTarget*>(data)->dispatchFrameComplete();
+            return G_SOURCE_CONTINUE;
+        }, this, nullptr);
+        g_source_attach(pacing.source, g_main_context_get_thread_default());
+    }
+    g_source_set_ready_time(pacing.source, readyTime);
+}
+
+void EGLTarget::dispatchFrameComplete()
+{
+    WPE_TRACE_SCOPE("EGLTarget::dispatchFrameComplete");
+    WPEAndroid::Trace::flow("Frame", WPEAndroid::Trace::frameFlowID(buffers.poolID, pacing.frameID),
+        WPEAndroid::Platform::TraceFlow::End);
+
+    pacing.dispatchTime = visibility.lastFrameComplete = g_get_monotonic_time();
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 void EGLTarget::frameRendered()
 {
-    EGLSyncKHR sync = renderer.createSyncKHR(eglGetCurrentDisplay(), EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+    WPE_TRACE_SCOPE("EGLTarget::frameRendered");
+    uint32_t frameID = ++buffers.frameID;
+
+    // Frames that did not start right away on completion, such as after an idle period, say
+    // nothing about how long rendering takes
+    if (pacing.dispatchTime) {
+        gint64 sample = g_get_monotonic_time() - pacing.dispatchTime;
+        if (sample < 100000)
+            pacing.renderTime = std::max(sample, pacing.renderTime - pacing.renderTime / 16);
+        pacing.dispatchTime = 0;
+    }
 
-    glFlush();
+    if (renderer.sharedMemory) {
+        // glReadPixels() waits for rendering to finish, so there is no fence to pass along.
+        // Rows end up in the same bottom-up order as with hardware buffers.
+        auto& current = *buffers.current;
+        if (current.shm.data()) {
+            glBindFramebuffer(GL_FRAMEBUFFER, current.gl.framebuffer);
+            glReadPixels(0, 0, renderer.width, renderer.height, GL_RGBA, GL_UNSIGNED_BYTE, current.shm.data());
+
+            IPC::BufferCommit commit;
+            commit.poolID = buffers.poolID;
+            commit.bufferID = current.bufferID;
+            commit.frameID = frameID;
+            commit.starvationEvents = renderer.starvationEvents;
+            commit.starvationMilliseconds = uint32_t(renderer.starvationMicroseconds / 1000);
+            commit.hasFence = false;
+            WPEAndroid::Trace::flow("Frame", WPEAndroid::Trace::frameFlowID(buffers.poolID, frameID), WPEAndroid::Platform::TraceFlow::Begin);
 
-    int syncFd = -1;
-    if (sync != EGL_NO_SYNC_KHR) {
-        // native fence fd will not be populated until flush() is done
-        syncFd = renderer.dupNativeFenceFDANDROID(eglGetCurrentDisplay(), sync);
-        if (syncFd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
-            ALOGV("EGLTarget: EGL_NO_NATIVE_FENCE_FD_ANDROID");
+            IPC::Message message;
+            IPC::BufferCommit::construct(message, commit);
+            m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
         }
-        renderer.destroySyncKHR(eglGetCurrentDisplay(), sync);
-    } else {
-        ALOGV("EGLTarget: EGL_NO_SYNC_KHR");
+
+        current.locked = true;
+        buffers.current = nullptr;
+        WPEAndroid::Trace::counter("EGLTarget locked buffers", lockedBuffers());
+        return;
     }
 
     if (buffers.current->object) {
+        // Without a fence the UI process has nothing to wait on, rendering must be over already
+        int syncFd = -1;
+        if (m_backend->hasCapability(IPC::CapabilityCommitFences))
+            syncFd = WPEAndroid::Platform::createNativeFence(eglGetCurrentDisplay());
+        if (syncFd == -1) {
+            ALOGV("EGLTarget: no native fence");
+            glFinish();
+        }
+
         IPC::BufferCommit commit;
         commit.poolID = buffers.poolID;
         commit.bufferID = buffers.current->bufferID;
+        commit.frameID = frameID;
+        commit.starvationEvents = renderer.starvationEvents;
+        commit.starvationMilliseconds = uint32_t(renderer.starvationMicroseconds / 1000);
+        commit.hasFence = syncFd != -1;
+        WPEAndroid::Trace::flow("Frame", WPEAndroid::Trace::frameFlowID(buffers.poolID, frameID), WPEAndroid::Platform::TraceFlow::Begin);
 
         IPC::Message message;
         IPC::BufferCommit::construct(message, commit);
         m_backend->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
-        m_backend->ipc().sendFileDescriptor(syncFd);
+        if (commit.hasFence) {
+            m_backend->ipc().sendFileDescriptor(syncFd);
+            close(syncFd);
+        }
     }
 
     buffers.current->locked = true;
     buffers.current = nullptr;
+    WPEAndroid::Trace::counter("EGLTarget locked buffers", lockedBuffers());
 }
 
 void EGLTarget::deinitialize()
 {
     ALOGD("EGLTarget::deinitialize()");
-    destroyBufferPool(buffers.pool, renderer.destroyImageKHR);
-
-    if (renderer.framebuffer)
-        glDeleteFramebuffers(1, &renderer.framebuffer);
-    renderer.framebuffer = 0;
+    destroyBufferPool(buffers.pool, renderer.entryPoints);
 }
 
 void EGLTarget::releaseBuffer(uint32_t poolID, uint32_t bufferID)
@@ -440,11 +1008,7 @@ void EGLTarget::releaseBuffer(uint32_t poolID, uint32_t bufferID)
             break;
         }
     }
-}
-
-void EGLTarget::handleMessage(char* data, size_t size)
-{
-    // TODO:
+    WPEAndroid::Trace::counter("EGLTarget locked buffers", lockedBuffers());
 }
 
 struct wpe_renderer_backend_egl_interface android_renderer_backend_egl_impl = {
@@ -500,7 +1064,7 @@ struct wpe_renderer_backend_egl_target_interface android_renderer_backend_egl_ta
     [] (void*) -> EGLNativeWindowType
     {
         ALOGV("android_renderer_backend_egl_target_impl::get_native_window()");
-        return nullptr;
+        return { };
     },
     // resize
     [] (void* data, uint32_t width, uint32_t height)
@@ -526,6 +1090,9 @@ struct wpe_renderer_backend_egl_target_interface android_renderer_backend_egl_ta
     },
 };
 
+// On the surfaceless platform, see get_platform, WebKit creates the contexts of workers,
+// OffscreenCanvas and sharing without a surface and renders them into framebuffers of its own.
+// Offscreen targets are only asked for a window when that fails, and there is none to give.
 struct wpe_renderer_backend_egl_offscreen_target_interface android_renderer_backend_egl_offscreen_target_impl = {
     // create
     [] () -> void*
@@ -541,6 +1108,7 @@ struct wpe_renderer_backend_egl_offscreen_target_interface android_renderer_back
     // get_native_window
     [] (void*) -> EGLNativeWindowType
     {
-        return nullptr;
+        ALOGV("android_renderer_backend_egl_offscreen_target_impl::get_native_window()");
+        return { };
     },
 };
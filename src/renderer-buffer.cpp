@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "renderer-buffer.h"
+
+#include "logging.h"
+#include "trace.h"
+
+void BufferEntryPoints::resolve()
+{
+    createImageKHR = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+        eglGetProcAddress("eglCreateImageKHR"));
+    destroyImageKHR = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+        eglGetProcAddress("eglDestroyImageKHR"));
+    imageTargetRenderbufferStorageOES = reinterpret_cast<PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC>(
+        eglGetProcAddress("glEGLImageTargetRenderbufferStorageOES"));
+}
+
+bool BufferEntryPoints::canImportBuffers() const
+{
+    return WPEAndroid::Platform::supportsBufferImport() && createImageKHR && imageTargetRenderbufferStorageOES;
+}
+
+bool createBufferFramebuffer(Buffer& buffer, uint32_t width, uint32_t height, const BufferEntryPoints& entryPoints,
+    const std::function<bool(Buffer&)>& colorStorage)
+{
+    std::array<GLuint, 2> renderbuffers { 0, 0 };
+    glGenRenderbuffers(2, renderbuffers.data());
+    buffer.gl.colorBuffer = renderbuffers[0];
+    buffer.gl.dsBuffer = renderbuffers[1];
+
+    glBindRenderbuffer(GL_RENDERBUFFER, buffer.gl.colorBuffer);
+    if (!colorStorage(buffer)) {
+        destroyBuffer(buffer, entryPoints);
+        return false;
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, buffer.gl.dsBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8_OES, width, height);
+
+    // Attachments of the per-buffer framebuffer never change during the buffer's lifetime,
+    // so completeness only needs to be validated here and not on every frame.
+    glGenFramebuffers(1, &buffer.gl.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, buffer.gl.framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, buffer.gl.colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, buffer.gl.dsBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, buffer.gl.dsBuffer);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        ALOGE("Buffer: GL_FRAMEBUFFER for buffer %u not COMPLETE: %#x", buffer.bufferID, status);
+        destroyBuffer(buffer, entryPoints);
+        return false;
+    }
+    return true;
+}
+
+bool importHardwareBuffer(Buffer& buffer, const AHardwareBuffer_Desc& description, const BufferEntryPoints& entryPoints)
+{
+    WPE_TRACE_SCOPE("importHardwareBuffer");
+
+    int ret = WPEAndroid::Platform::allocateBuffer(&description, &buffer.object);
+    if (!!ret || !buffer.object) {
+        ALOGV("  failed to allocate AHardwareBuffer: ret %d", ret);
+        buffer.object = nullptr;
+        return false;
+    }
+
+    EGLClientBuffer clientBuffer = WPEAndroid::Platform::clientBuffer(buffer.object);
+    buffer.egl.image = entryPoints.createImageKHR(eglGetCurrentDisplay(),
+        EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, clientBuffer, nullptr);
+    if (buffer.egl.image == EGL_NO_IMAGE_KHR) {
+        ALOGV("  failed to create EGLImage: error %#x", eglGetError());
+        WPEAndroid::Platform::releaseBuffer(buffer.object);
+        buffer.object = nullptr;
+        return false;
+    }
+
+    entryPoints.imageTargetRenderbufferStorageOES(GL_RENDERBUFFER, buffer.egl.image);
+    return true;
+}
+
+void destroyBuffer(Buffer& buffer, const BufferEntryPoints& entryPoints)
+{
+    if (buffer.gl.framebuffer)
+        glDeleteFramebuffers(1, &buffer.gl.framebuffer);
+    if (buffer.gl.colorBuffer)
+        glDeleteRenderbuffers(1, &buffer.gl.colorBuffer);
+    if (buffer.gl.dsBuffer)
+        glDeleteRenderbuffers(1, &buffer.gl.dsBuffer);
+    buffer.gl = { };
+
+    if (buffer.egl.image)
+        entryPoints.destroyImageKHR(eglGetCurrentDisplay(), buffer.egl.image);
+    buffer.egl = { };
+
+    if (buffer.object)
+        WPEAndroid::Platform::releaseBuffer(buffer.object);
+    buffer.shm.release();
+
+    buffer.locked = false;
+    buffer.object = nullptr;
+    buffer.stride = 0;
+}
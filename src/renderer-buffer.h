@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Buffers EGLTarget draws into, see renderer-backend-egl.cpp: a color renderbuffer backed by a
+// hardware buffer or shared memory, plus depth and stencil, attached to a framebuffer of their own. Everything here needs the context of the buffers current.
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "platform.h"
+#include "shared-memory.h"
+
+struct Buffer {
+    uint32_t bufferID { 0 };
+    bool locked { false };
+    AHardwareBuffer* object { nullptr };
+
+    // Used instead of object when rendering into shared memory buffers
+    WPEAndroid::SharedMemory shm;
+    uint32_t stride { 0 };
+
+    struct {
+        EGLImageKHR image { EGL_NO_IMAGE_KHR };
+    } egl;
+
+    struct {
+        GLuint colorBuffer { 0 };
+        GLuint dsBuffer { 0 };
+        GLuint framebuffer { 0 };
+    } gl;
+};
+
+// Format and usage of the buffers EGLTarget renders into
+static const uint32_t s_bufferFormat = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
+static const uint64_t s_bufferUsage = AHARDWAREBUFFER_USAGE_GPU_FRAMEBUFFER | AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE;
+
+struct BufferEntryPoints {
+    PFNEGLCREATEIMAGEKHRPROC createImageKHR { nullptr };
+    PFNEGLDESTROYIMAGEKHRPROC destroyImageKHR { nullptr };
+    PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC imageTargetRenderbufferStorageOES { nullptr };
+
+    void resolve();
+    // Whether hardware buffers can be imported and rendered to, shared memory is used otherwise
+    bool canImportBuffers() const;
+};
+
+// Creates the renderbuffers and the framebuffer of the buffer. colorStorage gives the bound color
+// renderbuffer its storage. If it fails or the framebuffer is incomplete, the buffer is destroyed.
+bool createBufferFramebuffer(Buffer&, uint32_t width, uint32_t height, const BufferEntryPoints&,
+    const std::function<bool(Buffer&)>& colorStorage);
+
+// Allocates buffer.object as described and makes it the storage of the bound renderbuffer, false
+// and no object if either fails
+bool importHardwareBuffer(Buffer&, const AHardwareBuffer_Desc&, const BufferEntryPoints&);
+
+void destroyBuffer(Buffer&, const BufferEntryPoints&);
+
+template<size_t size>
+void destroyBufferPool(std::array<Buffer, size>& pool, const BufferEntryPoints& entryPoints)
+{
+    for (auto& buffer : pool)
+        destroyBuffer(buffer, entryPoints);
+}
@@ -25,36 +25,117 @@
 #include <unordered_map>
 #include <vector>
 
+#include "shared-memory.h"
+#include "statistics.h"
+
 struct AHardwareBuffer;
 
+namespace IPC {
+class DeferredCall;
+}
+
 namespace WPEAndroid {
 
+class AndroidViewBackend;
 class RendererHostClientProxy;
 class ViewBackend;
+struct BufferFormat;
+struct ViewStatistics;
 
 
 class Buffer {
 public:
-    Buffer(AHardwareBuffer* hardwareBuffer, uint32_t poolID, uint32_t bufferID);
+    Buffer(AHardwareBuffer* hardwareBuffer, bool opaque, uint32_t poolID, uint32_t bufferID);
+    Buffer(int fd, uint32_t width, uint32_t height, uint32_t stride, uint32_t format, uint32_t poolID, uint32_t bufferID);
     ~Buffer();
 
     AHardwareBuffer* hardwareBuffer() const { return m_hardwareBuffer; }
+
+    // Only valid for shared memory buffers
+    void* data() const { return m_sharedMemory.data(); }
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    uint32_t stride() const { return m_stride; }
+
+    uint32_t format() const { return m_format; }
+    bool opaque() const { return m_opaque; }
+
+    // Size of the pixel storage, for both kinds of buffers
+    uint64_t byteSize() const { return m_byteSize; }
+
+    // Monotonic time of the last commit, in microseconds
+    int64_t commitTime() const { return m_commitTime; }
+    void setCommitTime(int64_t commitTime) { m_commitTime = commitTime; }
+
     uint32_t bufferID() const { return m_bufferID; }
     uint32_t poolID() const { return m_poolID; }
 
+    // Unlike the address of the buffer, never reused within the process
+    uint64_t uniqueID() const { return m_uniqueID; }
+
+    // Resources consumers attach to the buffer, destroyed along with it
+    void setUserData(const void* key, void* data, void (*destroyNotify)(void*));
+    void* userData(const void* key) const;
+
     bool locked() const { return m_locked; }
     void setLocked(bool locked) { m_locked = locked; }
 
     bool pendingDelete() const { return m_pendingDelete; }
     void setSPendingDelete(bool pendingDelete) { m_pendingDelete = pendingDelete; }
 
+    // Snapshots keep the buffer locked, releases arriving meanwhile are deferred until they finish
+    uint32_t snapshotHolds() const { return m_snapshotHolds; }
+    void acquireSnapshotHold() { m_snapshotHolds++; }
+    void releaseSnapshotHold() { m_snapshotHolds--; }
+
+    bool releaseDeferred() const { return m_releaseDeferred; }
+    void setReleaseDeferred(bool releaseDeferred) { m_releaseDeferred = releaseDeferred; }
+
 private:
 
     AHardwareBuffer* m_hardwareBuffer;
+    SharedMemory m_sharedMemory;
+    uint32_t m_width { 0 };
+    uint32_t m_height { 0 };
+    uint32_t m_stride { 0 };
+    uint32_t m_format { 0 };
+    bool m_opaque { false };
+    uint64_t m_byteSize { 0 };
+    int64_t m_commitTime { 0 };
     uint32_t m_bufferID;
     uint32_t m_poolID;
     bool m_locked;
     bool m_pendingDelete;
+    uint32_t m_snapshotHolds { 0 };
+    bool m_releaseDeferred { false };
+    uint64_t m_uniqueID;
+
+    struct UserData {
+        const void* key;
+        void* data;
+        void (*destroyNotify)(void*);
+    };
+    std::vector<UserData> m_userData;
+};
+
+// Feedback for the renderer gathered until the end of the UI loop iteration, see RendererHost::flushFeedback()
+struct PendingFeedback {
+    bool scheduled { false };
+    uint8_t releasedBuffers { 0 };
+    bool frameComplete { false };
+    uint32_t frameID { 0 };
+    int64_t presentationTime { 0 };
+    int64_t nextDeadline { 0 };
+};
+
+struct PoolStatistics {
+    Counter bufferAllocations { 0 };
+    Counter liveBufferBytes { 0 };
+    Counter pendingDeleteBuffers { 0 };
+
+    // Renderer totals, as of its last commit
+    Counter starvationEvents { 0 };
+    Counter starvationMilliseconds { 0 };
 };
 
 class BufferPool {
@@ -72,41 +153,101 @@ public:
 
     Buffer* releaseBuffer(int bufferId);
 
+    // Buffers currently held by the consumer
+    int64_t lockedBuffers() const;
+
+    PoolStatistics& statistics() { return m_statistics; }
+
+    PendingFeedback& pendingFeedback() { return m_pendingFeedback; }
+
 private:
     uint32_t m_id;
     RendererHostClientProxy* m_client;
     std::array<Buffer*, 4> m_buffers;
+    PoolStatistics m_statistics;
+    PendingFeedback m_pendingFeedback;
 };
 
 class RendererHost final {
 public:
     RendererHost();
+    ~RendererHost();
 
     static RendererHost& instance();
 
     int createClient();
 
-    uint32_t createBufferPool(RendererHostClientProxy* client);
+    // Returns the ID renderer targets of the view send along with their PoolConstruction
+    uint32_t registerView(ViewBackend* viewBackend);
+    void unregisterView(uint32_t viewId);
+
+    uint32_t createBufferPool(RendererHostClientProxy* client, uint32_t viewId);
+
+    // Quietly returns nullptr for views already destroyed
+    ViewBackend* findView(uint32_t viewId);
 
     BufferPool* findBufferPool(uint32_t);
 
     void registerViewBackend(uint32_t poolId, ViewBackend* viewBackend);
     void unregisterViewBackend(uint32_t poolId);
 
+    // For renderer targets going away, their view may be gone already
+    void unregisterPool(uint32_t poolId);
+
     ViewBackend* findViewBackend(uint32_t);
 
     void releaseBuffer(Buffer* buffer);
-    void frameComplete();
+    void snapshotFinished(Buffer* buffer);
+    void deleteBuffer(Buffer* buffer);
+    // For buffers taken out of their pool: deleted right away, or once released while the
+    // consumer or a snapshot still holds them
+    void retireBuffer(BufferPool&, Buffer* buffer);
+    void frameComplete(uint32_t poolId, uint32_t frameId, int64_t presentationTime, int64_t nextDeadline);
+    void setPoolFormat(uint32_t poolId, const BufferFormat&);
+    void setPoolVisible(uint32_t poolId, bool visible);
+
+    // Adds up the queueing delays of the connections the pools belong to, each counted once
+    void addQueueingDelays(const std::vector<uint32_t>& poolIds, WPEAndroidViewBackendStatistics&);
+
+    // With a batch handler, commits of every view are held until latchCommits() hands them over
+    // together instead of going to the handler of each view
+    void setCommitBatchHandler(void* context, WPEAndroid_CommitBatch);
+    bool batchesCommits() const { return !!m_commitBatch.handler; }
+    void batchCommit(AndroidViewBackend*, Buffer*, int fenceFD);
+    void latchCommits();
+    // Releases the commit of a view going away that was not latched yet
+    void dropBatchedCommit(AndroidViewBackend*);
 
 private:
 
+    // Unlike findViewBackend(), quietly returns nullptr for pools no longer owned by a view
+    ViewStatistics* viewStatistics(uint32_t poolId);
+
+    // Releases and frame completions of a pool reach the renderer as one FrameFeedback message,
+    // sent once the UI loop is done with the current iteration
+    void scheduleFeedback(BufferPool&);
+    void flushFeedback();
+
     // (poolId -> BufferPool)
     std::unordered_map<uint32_t, BufferPool*> m_bufferPoolMap;
 
     // (poolId -> ViewBackend)
     std::unordered_map<uint32_t, ViewBackend*> m_viewBackendMap;
 
+    // (viewId -> ViewBackend)
+    std::unordered_map<uint32_t, ViewBackend*> m_viewMap;
+
     std::vector<RendererHostClientProxy*> m_clients;
+
+    std::vector<uint32_t> m_pendingFeedbackPools;
+    std::unique_ptr<IPC::DeferredCall> m_feedbackFlush;
+
+    struct {
+        WPEAndroid_CommitBatch handler { nullptr };
+        void* context { nullptr };
+        // At most one per view, the last one it committed
+        std::vector<WPEAndroidCommit> commits;
+    } m_commitBatch;
 };
 
 } // namespace WPEAndroid
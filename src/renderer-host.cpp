@@ -18,7 +18,7 @@
 
 #include "renderer-host-private.h"
 
-#include <android/hardware_buffer.h>
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <unistd.h>
@@ -26,14 +26,15 @@
 
 #include "interfaces.h"
 #include "ipc.h"
+#include "ipc-capture.h"
 #include "ipc-messages.h"
 #include "logging.h"
+#include "platform.h"
+#include "trace.h"
 #include "view-backend-private.h"
 
 namespace WPEAndroid {
 
-uint32_t m_lastExportedPoolID = 0;
-
 class RendererHostClientProxy final : public IPC::Host::Handler {
 public:
     RendererHostClientProxy(RendererHost& host);
@@ -43,35 +44,114 @@ public:
 
     IPC::Host& ipc() { return m_ipcHost; }
 
+    // Negotiated in the handshake, none until then
+    bool hasCapability(IPC::Capability capability) const { return m_capabilities & capability; }
+
 private:
 
-    void constructPool();
-    void purgePool(uint32_t poolId);
-    void bufferAllocation(AHardwareBuffer* buffer, uint32_t, uint32_t);
-    void bufferCommit(uint32_t, uint32_t, int);
+    void handshake(const IPC::Handshake&);
+    void constructPool(uint32_t viewId);
+    // Buffers still held by the consumer go once released, bit N of bufferMask is bufferID N
+    void purgeBuffers(uint32_t poolId, uint32_t bufferMask);
+    void bufferAllocation(Buffer* buffer);
+    // Renderer statistics piggybacked on commits
+    struct RendererStatistics {
+        uint32_t starvationEvents;
+        uint32_t starvationMilliseconds;
+    };
+    void bufferCommit(uint32_t, uint32_t, uint32_t, const RendererStatistics&, int);
 
     // IPC::Host::Handle
     void handleMessage(char*, size_t) override;
+    void clientBecameUnresponsive() override;
 
     RendererHost& m_host;
 
     IPC::Host m_ipcHost;
+    // Nothing but a handshake of the same protocol version is understood until there is one
+    bool m_compatible { false };
+    uint32_t m_capabilities { 0 };
 };
 
 // Buffer
 
-Buffer::Buffer(AHardwareBuffer* hardwareBuffer, uint32_t poolID, uint32_t bufferID) {
+static uint64_t nextBufferUniqueID()
+{
+    static uint64_t uniqueID = 1;
+    return uniqueID++;
+}
+
+Buffer::Buffer(AHardwareBuffer* hardwareBuffer, bool opaque, uint32_t poolID, uint32_t bufferID)
+    : m_uniqueID(nextBufferUniqueID()) {
     // Buffer has been received from socket and ref count has been increased
-    // by AHardwareBuffer_recvHandleFromUnixSocket
+    // by Platform::receiveBuffer
     m_hardwareBuffer = hardwareBuffer;
     m_poolID = poolID;
     m_bufferID = bufferID;
     m_locked = false;
     m_pendingDelete = false;
+
+    if (hardwareBuffer) {
+        AHardwareBuffer_Desc description;
+        Platform::describeBuffer(hardwareBuffer, &description);
+        m_format = description.format;
+        // Formats renderers never allocate are counted as 32bpp
+        uint32_t bytesPerPixel = Platform::bytesPerPixel(m_format);
+        m_byteSize = uint64_t(description.stride) * description.height * (bytesPerPixel ? bytesPerPixel : 4);
+    }
+    m_opaque = opaque || m_format == AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM || m_format == AHARDWAREBUFFER_FORMAT_R5G6B5_UNORM;
+}
+
+Buffer::Buffer(int fd, uint32_t width, uint32_t height, uint32_t stride, uint32_t format, uint32_t poolID, uint32_t bufferID)
+    : m_uniqueID(nextBufferUniqueID()) {
+    // Shared memory is mapped once here and stays mapped for the lifetime of the buffer
+    m_hardwareBuffer = nullptr;
+    if (fd >= 0 && m_sharedMemory.map(fd, size_t(stride) * height))
+        m_byteSize = uint64_t(stride) * height;
+    m_width = width;
+    m_height = height;
+    m_stride = stride;
+    m_format = format;
+    m_opaque = format == AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM;
+    m_poolID = poolID;
+    m_bufferID = bufferID;
+    m_locked = false;
+    m_pendingDelete = false;
 }
 
 Buffer::~Buffer() {
-    AHardwareBuffer_release(m_hardwareBuffer);
+    // Consumer resources go first, they may still refer to the hardware buffer
+    auto userData = std::move(m_userData);
+    for (auto& entry : userData) {
+        if (entry.destroyNotify)
+            entry.destroyNotify(entry.data);
+    }
+
+    if (m_hardwareBuffer)
+        Platform::releaseBuffer(m_hardwareBuffer);
+}
+
+void Buffer::setUserData(const void* key, void* data, void (*destroyNotify)(void*)) {
+    auto it = std::find_if(m_userData.begin(), m_userData.end(), [key](const UserData& entry) { return entry.key == key; });
+    if (it == m_userData.end()) {
+        if (data)
+            m_userData.push_back({ key, data, destroyNotify });
+        return;
+    }
+
+    // The entry is replaced before the old data is destroyed, which may look it up again
+    auto replaced = *it;
+    if (data)
+        *it = { key, data, destroyNotify };
+    else
+        m_userData.erase(it);
+    if (replaced.destroyNotify)
+        replaced.destroyNotify(replaced.data);
+}
+
+void* Buffer::userData(const void* key) const {
+    auto it = std::find_if(m_userData.begin(), m_userData.end(), [key](const UserData& entry) { return entry.key == key; });
+    return it != m_userData.end() ? it->data : nullptr;
 }
 
 // BufferPool
@@ -87,10 +167,16 @@ Buffer* BufferPool::releaseBuffer(int bufferId) {
     return buffer;
 }
 
+int64_t BufferPool::lockedBuffers() const {
+    return std::count_if(m_buffers.begin(), m_buffers.end(), [](Buffer* buffer) { return buffer && buffer->locked(); });
+}
+
 // RendereHost
 
 RendererHost::RendererHost() = default;
 
+RendererHost::~RendererHost() = default;
+
 RendererHost& RendererHost::instance() {
     static RendererHost host;
     return host;
@@ -105,15 +191,39 @@ int RendererHost::createClient() {
     return clientProxy->releaseClientFD();
 }
 
-uint32_t RendererHost::createBufferPool(RendererHostClientProxy* client) {
-    ALOGD("RendererHost::createBufferPool()");
+uint32_t RendererHost::registerView(ViewBackend* viewBackend) {
+    // 0 is left out, it is what renderer targets use when they did not get their view's ID
+    static uint32_t viewID = 1;
+
+    m_viewMap.insert({ viewID, viewBackend });
+    return viewID++;
+}
+
+void RendererHost::unregisterView(uint32_t viewId) {
+    m_viewMap.erase(viewId);
+}
+
+uint32_t RendererHost::createBufferPool(RendererHostClientProxy* client, uint32_t viewId) {
+    ALOGD("RendererHost::createBufferPool() view %u", viewId);
     static uint32_t poolID = 0;
 
     auto* bufferPool = new BufferPool(poolID++, client);
     m_bufferPoolMap.insert({ bufferPool->id(), bufferPool });
+
+    // The pool belongs to its view before the reply is even sent, so that no commit can get
+    // ahead of the registration
+    if (auto* view = findView(viewId))
+        view->registerPool(bufferPool->id());
+    else
+        ALOGW("RendererHost::createBufferPool(): no view with viewId %" PRIu32 ", its frames will be dropped", viewId);
     return bufferPool->id();
 }
 
+ViewBackend* RendererHost::findView(uint32_t viewId) {
+    auto it = m_viewMap.find(viewId);
+    return it != m_viewMap.end() ? it->second : nullptr;
+}
+
 BufferPool* RendererHost::findBufferPool(uint32_t poolID) {
     auto it = m_bufferPoolMap.find(poolID);
     if (it == m_bufferPoolMap.end()) {
@@ -134,6 +244,12 @@ void RendererHost::unregisterViewBackend(uint32_t poolId) {
     }
 }
 
+void RendererHost::unregisterPool(uint32_t poolId) {
+    auto it = m_viewBackendMap.find(poolId);
+    if (it != m_viewBackendMap.end())
+        it->second->unregisterPool(poolId);
+}
+
 ViewBackend* RendererHost::findViewBackend(uint32_t poolId) {
     auto it = m_viewBackendMap.find(poolId);
     if (it == m_viewBackendMap.end()) {
@@ -143,36 +259,234 @@ ViewBackend* RendererHost::findViewBackend(uint32_t poolId) {
     return it->second;
 }
 
+ViewStatistics* RendererHost::viewStatistics(uint32_t poolId) {
+    auto it = m_viewBackendMap.find(poolId);
+    if (it == m_viewBackendMap.end())
+        return nullptr;
+    return &it->second->statistics();
+}
+
 void RendererHost::releaseBuffer(Buffer* buffer) {
+    WPE_TRACE_SCOPE("RendererHost::releaseBuffer");
+
+    if (buffer->snapshotHolds()) {
+        buffer->setReleaseDeferred(true);
+        return;
+    }
+
+    buffer->setReleaseDeferred(false);
     buffer->setLocked(false);
 
+    if (auto* statistics = viewStatistics(buffer->poolID())) {
+        increment(statistics->framesReleased);
+        statistics->commitToRelease.add(g_get_monotonic_time() - buffer->commitTime());
+    }
+
     if (buffer->pendingDelete()) {
-        delete buffer;
+        deleteBuffer(buffer);
         return;
     }
 
     auto* bufferPool = findBufferPool(buffer->poolID());
+    Trace::counter("RendererHost locked buffers", bufferPool->lockedBuffers());
+
+    bufferPool->pendingFeedback().releasedBuffers |= 1 << buffer->bufferID();
+    scheduleFeedback(*bufferPool);
+}
+
+void RendererHost::snapshotFinished(Buffer* buffer) {
+    buffer->releaseSnapshotHold();
+    if (!buffer->snapshotHolds() && buffer->releaseDeferred())
+        releaseBuffer(buffer);
+}
+
+// Buffers that made it into a pool are deleted here, to keep the pool statistics right
+void RendererHost::deleteBuffer(Buffer* buffer) {
+    if (!buffer)
+        return;
+
+    auto it = m_bufferPoolMap.find(buffer->poolID());
+    if (it != m_bufferPoolMap.end()) {
+        auto& statistics = it->second->statistics();
+        decrement(statistics.liveBufferBytes, buffer->byteSize());
+        if (buffer->pendingDelete())
+            decrement(statistics.pendingDeleteBuffers);
+    }
+    delete buffer;
+}
+
+void RendererHost::retireBuffer(BufferPool& bufferPool, Buffer* buffer) {
+    if (!buffer)
+        return;
+
+    if (!buffer->locked()) {
+        deleteBuffer(buffer);
+        return;
+    }
+
+    buffer->setSPendingDelete(true);
+    increment(bufferPool.statistics().pendingDeleteBuffers);
+}
+
+void RendererHost::frameComplete(uint32_t poolId, uint32_t frameId, int64_t presentationTime, int64_t nextDeadline) {
+    WPE_TRACE_SCOPE("RendererHost::frameComplete");
+    auto* bufferPool = findBufferPool(poolId);
+    if (!bufferPool)
+        return;
+
+    Trace::flow("Frame", Trace::frameFlowID(poolId, frameId), Platform::TraceFlow::Step);
 
-    IPC::ReleaseBuffer release;
-    release.poolID = buffer->poolID();
-    release.bufferID = buffer->bufferID();
+    auto& feedback = bufferPool->pendingFeedback();
+    feedback.frameComplete = true;
+    feedback.frameID = frameId;
+    feedback.presentationTime = presentationTime;
+    feedback.nextDeadline = nextDeadline;
+    scheduleFeedback(*bufferPool);
+}
+
+void RendererHost::setPoolFormat(uint32_t poolId, const BufferFormat& bufferFormat) {
+    auto* bufferPool = findBufferPool(poolId);
+    if (!bufferPool || !bufferPool->client()->hasCapability(IPC::CapabilityBufferFormats))
+        return;
+
+    IPC::PoolFormat poolFormat = { };
+    poolFormat.poolID = poolId;
+    poolFormat.format = bufferFormat.format;
+    poolFormat.usage = bufferFormat.usage;
+    poolFormat.opaque = bufferFormat.opaque;
 
     IPC::Message message;
-    IPC::ReleaseBuffer::construct(message, release);
+    IPC::PoolFormat::construct(message, poolFormat);
     bufferPool->client()->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
-void RendererHost::frameComplete() {
-    auto* bufferPool = findBufferPool(m_lastExportedPoolID);
+void RendererHost::setPoolVisible(uint32_t poolId, bool visible) {
+    auto* bufferPool = findBufferPool(poolId);
+    if (!bufferPool || !bufferPool->client()->hasCapability(IPC::CapabilityVisibility))
+        return;
 
-    IPC::FrameComplete frameComplete;
-    frameComplete.poolID = m_lastExportedPoolID;
+    IPC::PoolVisibility poolVisibility = { };
+    poolVisibility.poolID = poolId;
+    poolVisibility.visible = visible;
 
     IPC::Message message;
-    IPC::FrameComplete::construct(message, frameComplete);
+    IPC::PoolVisibility::construct(message, poolVisibility);
     bufferPool->client()->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
+void RendererHost::scheduleFeedback(BufferPool& bufferPool) {
+    auto& feedback = bufferPool.pendingFeedback();
+    if (feedback.scheduled)
+        return;
+
+    feedback.scheduled = true;
+    m_pendingFeedbackPools.push_back(bufferPool.id());
+
+    if (!m_feedbackFlush)
+        m_feedbackFlush.reset(new IPC::DeferredCall("WPEBackend-android::feedback", [this] { flushFeedback(); }));
+    m_feedbackFlush->schedule();
+}
+
+void RendererHost::flushFeedback() {
+    WPE_TRACE_SCOPE("RendererHost::flushFeedback");
+
+    auto poolIds = std::move(m_pendingFeedbackPools);
+    m_pendingFeedbackPools.clear();
+    for (uint32_t poolId : poolIds) {
+        auto it = m_bufferPoolMap.find(poolId);
+        if (it == m_bufferPoolMap.end())
+            continue;
+
+        auto& bufferPool = *it->second;
+        auto pending = bufferPool.pendingFeedback();
+        bufferPool.pendingFeedback() = { };
+
+        IPC::FrameFeedback feedback = { };
+        feedback.poolID = poolId;
+        feedback.frameID = pending.frameID;
+        feedback.releasedBuffers = pending.releasedBuffers;
+        feedback.frameComplete = pending.frameComplete;
+        if (bufferPool.client()->hasCapability(IPC::CapabilityFrameTiming))
+            feedback.presentationTime = pending.presentationTime;
+        if (feedback.presentationTime && pending.nextDeadline > pending.presentationTime)
+            feedback.nextDeadlineOffset = uint32_t(std::min<int64_t>(pending.nextDeadline - pending.presentationTime, UINT32_MAX));
+
+        IPC::Message message;
+        IPC::FrameFeedback::construct(message, feedback);
+        // A renderer lagging behind gets the feedback still queued for the pool updated instead
+        bufferPool.client()->ipc().sendMessage(IPC::Message::data(message), IPC::Message::size, IPC::FrameFeedback::merge);
+    }
+}
+
+void RendererHost::setCommitBatchHandler(void* context, WPEAndroid_CommitBatch handler) {
+    // Commits already held belong to the previous handler
+    if (!m_commitBatch.commits.empty())
+        latchCommits();
+
+    m_commitBatch.handler = handler;
+    m_commitBatch.context = context;
+}
+
+void RendererHost::batchCommit(AndroidViewBackend* androidViewBackend, Buffer* buffer, int fenceFD) {
+    auto* view = reinterpret_cast<WPEAndroidViewBackend*>(androidViewBackend);
+    auto it = std::find_if(m_commitBatch.commits.begin(), m_commitBatch.commits.end(),
+        [view](const WPEAndroidCommit& commit) { return commit.viewBackend == view; });
+    if (it == m_commitBatch.commits.end()) {
+        m_commitBatch.commits.push_back({ view, reinterpret_cast<WPEAndroidBuffer*>(buffer), fenceFD });
+        return;
+    }
+
+    // The consumer never sees the frame it replaces, which goes back to the renderer right away
+    WPE_TRACE_SCOPE("RendererHost::replaceBatchedCommit");
+    auto* replaced = reinterpret_cast<Buffer*>(it->buffer);
+    if (it->fenceFD != -1)
+        close(it->fenceFD);
+    it->buffer = reinterpret_cast<WPEAndroidBuffer*>(buffer);
+    it->fenceFD = fenceFD;
+    releaseBuffer(replaced);
+}
+
+void RendererHost::latchCommits() {
+    WPE_TRACE_SCOPE("RendererHost::latchCommits");
+
+    // The handler may well commit or latch again
+    auto commits = std::move(m_commitBatch.commits);
+    m_commitBatch.commits.clear();
+    if (!commits.empty() && m_commitBatch.handler)
+        m_commitBatch.handler(m_commitBatch.context, commits.data(), commits.size());
+}
+
+void RendererHost::dropBatchedCommit(AndroidViewBackend* androidViewBackend) {
+    auto* view = reinterpret_cast<WPEAndroidViewBackend*>(androidViewBackend);
+    auto it = std::find_if(m_commitBatch.commits.begin(), m_commitBatch.commits.end(),
+        [view](const WPEAndroidCommit& commit) { return commit.viewBackend == view; });
+    if (it == m_commitBatch.commits.end())
+        return;
+
+    auto* buffer = reinterpret_cast<Buffer*>(it->buffer);
+    if (it->fenceFD != -1)
+        close(it->fenceFD);
+    m_commitBatch.commits.erase(it);
+    releaseBuffer(buffer);
+}
+
+void RendererHost::addQueueingDelays(const std::vector<uint32_t>& poolIds, WPEAndroidViewBackendStatistics& statistics) {
+    std::vector<RendererHostClientProxy*> clients;
+    for (uint32_t poolId : poolIds) {
+        auto it = m_bufferPoolMap.find(poolId);
+        if (it == m_bufferPoolMap.end())
+            continue;
+
+        auto* client = it->second->client();
+        if (std::find(clients.begin(), clients.end(), client) != clients.end())
+            continue;
+        clients.push_back(client);
+
+        client->ipc().queueingDelay(IPC::Lane::Latency).addTo(statistics.latencyLaneQueueing);
+        client->ipc().queueingDelay(IPC::Lane::Bulk).addTo(statistics.bulkLaneQueueing);
+    }
+}
+
 // RendereHostClientProxy
 
 RendererHostClientProxy::RendererHostClientProxy(RendererHost& host)
@@ -188,102 +502,184 @@ int RendererHostClientProxy::releaseClientFD() {
     return m_ipcHost.releaseClientFD(true);
 }
 
-void RendererHostClientProxy::constructPool()
+void RendererHostClientProxy::handshake(const IPC::Handshake& handshake)
+{
+    // The layout of the messages themselves differs between versions
+    m_compatible = handshake.protocolVersion == IPC::protocolVersion;
+    if (m_compatible)
+        m_capabilities = handshake.capabilities & IPC::supportedCapabilities;
+    else
+        ALOGE("RendererHostClientProxy: WebProcess speaks protocol version %u instead of %u, disconnecting it",
+            handshake.protocolVersion, IPC::protocolVersion);
+    ALOGD("RendererHostClientProxy::handshake(): capabilities %#x", m_capabilities);
+
+    IPC::HandshakeReply reply = { };
+    reply.protocolVersion = IPC::protocolVersion;
+    reply.capabilities = m_capabilities;
+
+    IPC::Message message;
+    IPC::HandshakeReply::construct(message, reply);
+    m_ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+
+    // The reply lets the WebProcess report the mismatch before it sees the connection closed
+    if (!m_compatible)
+        m_ipcHost.shutdown();
+}
+
+void RendererHostClientProxy::constructPool(uint32_t viewId)
 {
-    uint32_t poolID = m_host.createBufferPool(this);
+    uint32_t poolID = m_host.createBufferPool(this, viewId);
 
-    IPC::PoolConstructionReply poolConstructionReply;
+    IPC::PoolConstructionReply poolConstructionReply = { };
     poolConstructionReply.poolID = poolID;
 
+    // The first buffers are then allocated right, with no PoolFormat racing them
+    auto* view = m_host.findView(viewId);
+    if (view && hasCapability(IPC::CapabilityBufferFormats)) {
+        poolConstructionReply.format = view->bufferFormat().format;
+        poolConstructionReply.usage = view->bufferFormat().usage;
+        poolConstructionReply.opaque = view->bufferFormat().opaque;
+    }
+    if (view && hasCapability(IPC::CapabilityVisibility))
+        poolConstructionReply.hidden = !view->visible();
+
     IPC::Message message;
     IPC::PoolConstructionReply::construct(message, poolConstructionReply);
     m_ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
-void RendererHostClientProxy::purgePool(uint32_t poolId) {
+void RendererHostClientProxy::purgeBuffers(uint32_t poolId, uint32_t bufferMask) {
     auto* bufferPool = m_host.findBufferPool(poolId);
+    if (!bufferPool)
+        return;
 
-    for(int i=0; i<bufferPool->size(); i++) {
-        auto* buffer = bufferPool->getBuffer(i);
-        if (buffer) {
-            if (buffer->locked()) {
-                buffer->setSPendingDelete(true);
-            } else {
-                delete buffer;
-            }
-            bufferPool->setBuffer(i, nullptr);
-        }
+    for (uint32_t i = 0; i < bufferPool->size(); i++) {
+        if (bufferMask & (1 << i))
+            m_host.retireBuffer(*bufferPool, bufferPool->releaseBuffer(i));
     }
 }
 
-void RendererHostClientProxy::bufferAllocation(AHardwareBuffer* hardwareBuffer, uint32_t poolID, uint32_t bufferID)
+void RendererHostClientProxy::bufferAllocation(Buffer* buffer)
 {
-    auto* bufferPool = m_host.findBufferPool(poolID);
+    auto* bufferPool = m_host.findBufferPool(buffer->poolID());
 
-    if (bufferID >= bufferPool->size()) {
-        if (hardwareBuffer)
-            AHardwareBuffer_release(hardwareBuffer);
+    // The pool may have been unregistered while the allocation was in flight
+    if (!bufferPool || buffer->bufferID() >= bufferPool->size()) {
+        delete buffer;
         return;
     }
 
-    auto* oldBuffer = bufferPool->releaseBuffer(bufferID);
-    if (oldBuffer)
-        delete oldBuffer;
+    // A snapshot may still be reading the buffer this one replaces
+    m_host.retireBuffer(*bufferPool, bufferPool->releaseBuffer(buffer->bufferID()));
 
-    auto* buffer = new Buffer(hardwareBuffer, poolID, bufferID);
-    bufferPool->setBuffer(bufferID, buffer);
+    bufferPool->setBuffer(buffer->bufferID(), buffer);
+    increment(bufferPool->statistics().bufferAllocations);
+    increment(bufferPool->statistics().liveBufferBytes, buffer->byteSize());
 }
 
-void RendererHostClientProxy::bufferCommit(uint32_t poolID, uint32_t bufferID, int fenceFD)
+void RendererHostClientProxy::bufferCommit(uint32_t poolID, uint32_t bufferID, uint32_t frameID, const RendererStatistics& rendererStatistics, int fenceFD)
 {
+    Trace::refresh();
+    WPE_TRACE_SCOPE("RendererHostClientProxy::bufferCommit");
+    Trace::flow("Frame", Trace::frameFlowID(poolID, frameID), Platform::TraceFlow::Step);
+
     auto* bufferPool = m_host.findBufferPool(poolID);
 
-    if (bufferID >= bufferPool->size())
+    if (!bufferPool || bufferID >= bufferPool->size()) {
+        if (fenceFD != -1)
+            close(fenceFD);
         return;
+    }
 
     auto* buffer = bufferPool->getBuffer(bufferID);
 
-    // TODO: This is only temprorary solution for PSON support. To make this work correctly
-    // interface change is needed where we received pool id from frame complete callback.
-    m_lastExportedPoolID = poolID;
+    auto& poolStatistics = bufferPool->statistics();
+    poolStatistics.starvationEvents.store(rendererStatistics.starvationEvents, std::memory_order_relaxed);
+    poolStatistics.starvationMilliseconds.store(rendererStatistics.starvationMilliseconds, std::memory_order_relaxed);
 
     auto* viewBackend = m_host.findViewBackend(poolID);
     if (viewBackend) {
+        // With PSON the view may have pools in several WebProcesses, frame completion goes to
+        // the one that committed last
+        viewBackend->bufferCommitted(poolID, frameID);
+
         auto* androidBackend = viewBackend->androidBackend();
         if (androidBackend) {
             buffer->setLocked(true);
+            buffer->setCommitTime(g_get_monotonic_time());
+            increment(viewBackend->statistics().framesCommitted);
+            Trace::counter("RendererHost locked buffers", bufferPool->lockedBuffers());
             androidBackend->commitBuffer(buffer, fenceFD);
-        }
+        } else if (fenceFD != -1)
+            close(fenceFD);
     } else {
         // In some cases viewbackend might have been already destroyed when buffer commit message
         // is dispatched from ipc queue. It means that webview is already destroyed or being destroyed
         // and all IPC is being torn down.
         //
         // In such case all we can do is to release the buffer
-        if (buffer) {
-            delete bufferPool->releaseBuffer(bufferID);
-        }
+        if (fenceFD != -1)
+            close(fenceFD);
+        if (buffer)
+            m_host.retireBuffer(*bufferPool, bufferPool->releaseBuffer(bufferID));
     }
 }
 
+void RendererHostClientProxy::clientBecameUnresponsive() {
+    // Messages keep queueing for it, frame feedback folded into what is already queued
+    ALOGE("RendererHostClientProxy: renderer unresponsive, its messages are piling up");
+    IPC::FlightRecorder::dumpAllOnAnomaly("unresponsive renderer");
+}
+
 void RendererHostClientProxy::handleMessage(char*data, size_t size) {
     ALOGV("RendererHostClientProxy::handleMessage() %p[%zu]", data, size);
+    WPE_TRACE_SCOPE("RendererHostClientProxy::handleMessage");
     if (size != IPC::Message::size)
         return;
 
     auto& message = IPC::Message::cast(data);
+    if (!m_compatible && message.messageCode != IPC::Handshake::code) {
+        // Protocol version 1 had no handshake, nothing it sends can be understood
+        ALOGE("RendererHostClientProxy: message %" PRIu64 " without a compatible handshake, disconnecting the WebProcess",
+            message.messageCode);
+        m_ipcHost.shutdown();
+        return;
+    }
+
     switch (message.messageCode) {
+    case IPC::Handshake::code:
+    {
+        auto handshake = IPC::Handshake::from(message);
+        ALOGV("  Handshake: version %u, capabilities %#x", handshake.protocolVersion, handshake.capabilities);
+        this->handshake(handshake);
+        break;
+    }
     case IPC::PoolConstruction::code:
     {
-        ALOGV("  PoolConstruction");
-        constructPool();
+        auto construction = IPC::PoolConstruction::from(message);
+        ALOGV("  PoolConstruction: viewID %u", construction.viewID);
+        constructPool(construction.viewID);
+        break;
+    }
+    case IPC::UnregisterPool::code:
+    {
+        auto unregisterPool = IPC::UnregisterPool::from(message);
+        ALOGV("  UnregisterPool: poolID %u", unregisterPool.poolID);
+        m_host.unregisterPool(unregisterPool.poolID);
         break;
     }
     case IPC::PoolPurge::code:
     {
         auto purge = IPC::PoolPurge::from(message);
         ALOGV("  PoolPurge: poolID %d", purge.poolID);
-        purgePool(purge.poolID);
+        purgeBuffers(purge.poolID, UINT32_MAX);
+        break;
+    }
+    case IPC::PoolPark::code:
+    {
+        auto park = IPC::PoolPark::from(message);
+        ALOGV("  PoolPark: poolID %u, parkedBuffers %#x", park.poolID, park.parkedBuffers);
+        purgeBuffers(park.poolID, park.parkedBuffers);
         break;
     }
     case IPC::BufferAllocation::code:
@@ -295,26 +691,69 @@ void RendererHostClientProxy::handleMessage(char*data, size_t size) {
         AHardwareBuffer* buffer = nullptr;
         int ret = 0;
         while (true) {
-            ret = AHardwareBuffer_recvHandleFromUnixSocket(m_ipcHost.socketFd(), &buffer);
+            ret = Platform::receiveBuffer(m_ipcHost.socketFd(), &buffer);
             if (!ret || ret != -EAGAIN)
                 break;
         }
         ALOGV("  BufferAllocation: ret %d, buffer %p\n", ret, buffer);
+        if (ret == -EPIPE) {
+            // Part of the buffer was read, what follows cannot be parsed anymore
+            m_ipcHost.shutdown();
+            break;
+        }
+
+        if (buffer && IPC::Capture::isActive()) {
+            AHardwareBuffer_Desc description;
+            Platform::describeBuffer(buffer, &description);
+            IPC::Capture::recordBufferDescription(m_ipcHost.captureEndpoint(), allocation.poolID, allocation.bufferID, description);
+        }
+
+        // Renderers without the capability leave the field uninitialized
+        bool opaque = hasCapability(IPC::CapabilityBufferFormats) && allocation.opaque;
+        bufferAllocation(new Buffer(buffer, opaque, allocation.poolID, allocation.bufferID));
+        break;
+    }
+    case IPC::SharedMemoryBufferAllocation::code:
+    {
+        auto allocation = IPC::SharedMemoryBufferAllocation::from(message);
+        ALOGV("  SharedMemoryBufferAllocation: poolID %u, bufferID %u, %ux%u stride %u",
+            allocation.poolID, allocation.bufferID, allocation.width, allocation.height, allocation.stride);
+
+        int fd = -1;
+        while (true) {
+            fd = m_ipcHost.receiveFileDescriptor();
+            if (!fd || fd != -EAGAIN)
+                break;
+        }
 
-        bufferAllocation(buffer, allocation.poolID, allocation.bufferID);
+        if (!hasCapability(IPC::CapabilitySharedMemoryBuffers)) {
+            ALOGW("RendererHostClientProxy: shared memory buffer from a WebProcess that did not announce them");
+            if (fd >= 0)
+                close(fd);
+            break;
+        }
+        bufferAllocation(new Buffer(fd, allocation.width, allocation.height, allocation.stride, allocation.format,
+            allocation.poolID, allocation.bufferID));
         break;
     }
     case IPC::BufferCommit::code:
     {
         auto commit = IPC::BufferCommit::from(message);
         ALOGV("  BufferCommit: poolID %u, bufferID %u", commit.poolID, commit.bufferID);
+
         int fenceFD = -1;
-        while (true) {
+        while (commit.hasFence) {
             fenceFD = m_ipcHost.receiveFileDescriptor();
             if (!fenceFD || fenceFD != -EAGAIN)
                 break;
         }
-        bufferCommit(commit.poolID, commit.bufferID, fenceFD);
+        if (fenceFD >= 0 && !hasCapability(IPC::CapabilityCommitFences)) {
+            ALOGW("RendererHostClientProxy: fence from a WebProcess that did not announce them");
+            close(fenceFD);
+        }
+        if (fenceFD < 0 || !hasCapability(IPC::CapabilityCommitFences))
+            fenceFD = -1;
+        bufferCommit(commit.poolID, commit.bufferID, commit.frameID, { commit.starvationEvents, commit.starvationMilliseconds }, fenceFD);
         break;
     }
     default:
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "shared-memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace WPEAndroid {
+
+SharedMemory::~SharedMemory()
+{
+    release();
+}
+
+bool SharedMemory::allocate(size_t size)
+{
+    release();
+
+    // memfd_create() is only exposed by bionic starting with API level 30
+    int fd = syscall(__NR_memfd_create, "WPEBackend-android", MFD_CLOEXEC);
+    if (fd == -1) {
+        ALOGE("SharedMemory: memfd_create failed: %s", strerror(errno));
+        return false;
+    }
+
+    int ret;
+    do {
+        ret = ftruncate(fd, size);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        ALOGE("SharedMemory: failed to resize region to %zu bytes: %s", size, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    return map(fd, size);
+}
+
+bool SharedMemory::map(int fd, size_t size)
+{
+    release();
+
+    // The size comes from the other side. Accessing pages past the end of the file would raise
+    // SIGBUS, so a short file is never mapped.
+    struct stat status;
+    if (fstat(fd, &status) == -1 || status.st_size < 0 || uint64_t(status.st_size) < size) {
+        ALOGE("SharedMemory: fd %d holds fewer than the %zu bytes to map", fd, size);
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ALOGE("SharedMemory: failed to map %zu bytes from fd %d: %s", size, fd, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    m_data = data;
+    m_size = size;
+    return true;
+}
+
+void SharedMemory::release()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+    if (m_fd != -1)
+        close(m_fd);
+
+    m_fd = -1;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+} // namespace WPEAndroid
@@ -0,0 +1,53 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace WPEAndroid {
+
+// memfd-backed memory region that is mapped once and shared between the renderer and the host
+// by passing its file descriptor over the IPC socket.
+class SharedMemory {
+public:
+    SharedMemory() = default;
+    ~SharedMemory();
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Creates a new region of the given size
+    bool allocate(size_t size);
+    // Maps a region received from the other side, taking ownership of the file descriptor. Fails
+    // if the file is shorter than size.
+    bool map(int fd, size_t size);
+    void release();
+
+    int fd() const { return m_fd; }
+    void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    int m_fd { -1 };
+    void* m_data { nullptr };
+    size_t m_size { 0 };
+};
+
+} // namespace WPEAndroid
@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+
+#include "logging.h"
+#include "pixel-kernels.h"
+#include "platform.h"
+#include "renderer-host-private.h"
+
+namespace WPEAndroid {
+
+void Snapshot::request(const Buffer& buffer, int fenceFD, float scale, Callback&& callback)
+{
+    auto* snapshot = new Snapshot(buffer, fenceFD, scale, std::move(callback));
+
+    GTask* task = g_task_new(nullptr, nullptr, finished, nullptr);
+    g_task_set_task_data(task, snapshot, [](gpointer data) {
+        delete static_cast<Snapshot*>(data);
+    });
+    g_task_run_in_thread(task, run);
+    g_object_unref(task);
+}
+
+Snapshot::Snapshot(const Buffer& buffer, int fenceFD, float scale, Callback&& callback)
+    : m_fenceFD(fenceFD)
+    , m_scale(std::min(std::max(scale, 0.f), 1.f))
+    , m_callback(std::move(callback))
+{
+    m_hardwareBuffer = buffer.hardwareBuffer();
+    if (m_hardwareBuffer) {
+        Platform::acquireBuffer(m_hardwareBuffer);
+        return;
+    }
+
+    m_data = buffer.data();
+    m_width = buffer.width();
+    m_height = buffer.height();
+    m_stride = buffer.stride();
+}
+
+Snapshot::~Snapshot()
+{
+    if (m_hardwareBuffer)
+        Platform::releaseBuffer(m_hardwareBuffer);
+    if (m_fenceFD != -1)
+        close(m_fenceFD);
+}
+
+bool Snapshot::readback()
+{
+    void* data = const_cast<void*>(m_data);
+    if (m_hardwareBuffer) {
+        AHardwareBuffer_Desc description;
+        Platform::describeBuffer(m_hardwareBuffer, &description);
+        if (description.format != AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM && description.format != AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM) {
+            ALOGW("Snapshot: buffers of format %u cannot be read back", description.format);
+            return false;
+        }
+        m_width = description.width;
+        m_height = description.height;
+        // AHardwareBuffer strides count pixels
+        m_stride = description.stride * Platform::bytesPerPixel(description.format);
+
+        // Lock waits for rendering to finish and takes ownership of the fence
+        int ret = Platform::lockBuffer(m_hardwareBuffer, AHARDWAREBUFFER_USAGE_CPU_READ_RARELY, m_fenceFD, &data);
+        m_fenceFD = -1;
+        if (ret) {
+            ALOGW("Snapshot: failed to lock AHardwareBuffer: ret %d", ret);
+            return false;
+        }
+    }
+
+    bool result = false;
+    if (data && m_width && m_height) {
+        m_scaledWidth = std::max<uint32_t>(1, std::lround(m_width * m_scale));
+        m_scaledHeight = std::max<uint32_t>(1, std::lround(m_height * m_scale));
+        m_pixels.resize(size_t(m_scaledWidth) * m_scaledHeight * 4);
+
+        PixelKernels::boxDownscale(PixelKernels::kernels(), static_cast<const uint8_t*>(data), m_width, m_height, m_stride,
+            m_pixels.data(), m_scaledWidth, m_scaledHeight, m_scaledWidth * 4);
+        result = true;
+    }
+
+    if (m_hardwareBuffer)
+        Platform::unlockBuffer(m_hardwareBuffer);
+    return result;
+}
+
+void Snapshot::run(GTask* task, gpointer, gpointer taskData, GCancellable*)
+{
+    auto& snapshot = *static_cast<Snapshot*>(taskData);
+    g_task_return_boolean(task, snapshot.readback());
+}
+
+void Snapshot::finished(GObject*, GAsyncResult* result, gpointer)
+{
+    auto& snapshot = *static_cast<Snapshot*>(g_task_get_task_data(G_TASK(result)));
+    if (!g_task_propagate_boolean(G_TASK(result), nullptr)) {
+        snapshot.m_callback(nullptr, 0, 0, 0);
+        return;
+    }
+
+    snapshot.m_callback(snapshot.m_pixels.data(), snapshot.m_scaledWidth, snapshot.m_scaledHeight, snapshot.m_scaledWidth * 4);
+}
+
+} // namespace WPEAndroid
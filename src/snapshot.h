@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <gio/gio.h>
+#include <vector>
+
+struct AHardwareBuffer;
+
+namespace WPEAndroid {
+
+class Buffer;
+
+// Downscaled CPU copy of a committed buffer. Readback and scaling happen on a GLib worker thread,
+// the callback is invoked on the thread-default main context of the thread requesting it.
+class Snapshot {
+public:
+    // pixels is nullptr if the snapshot failed, otherwise RGBA8 and only valid during the call
+    using Callback = std::function<void(const void* pixels, uint32_t width, uint32_t height, uint32_t stride)>;
+
+    // The caller has to keep the buffer alive and untouched by the renderer until callback is called.
+    // fenceFD is owned by the snapshot.
+    static void request(const Buffer& buffer, int fenceFD, float scale, Callback&& callback);
+
+    ~Snapshot();
+
+private:
+    Snapshot(const Buffer&, int fenceFD, float scale, Callback&&);
+
+    static void run(GTask*, gpointer, gpointer, GCancellable*);
+    static void finished(GObject*, GAsyncResult*, gpointer);
+
+    bool readback();
+
+    AHardwareBuffer* m_hardwareBuffer { nullptr };
+    const void* m_data { nullptr };
+    uint32_t m_width { 0 };
+    uint32_t m_height { 0 };
+    uint32_t m_stride { 0 };
+    int m_fenceFD { -1 };
+    float m_scale { 1 };
+
+    Callback m_callback;
+
+    std::vector<uint8_t> m_pixels;
+    uint32_t m_scaledWidth { 0 };
+    uint32_t m_scaledHeight { 0 };
+};
+
+} // namespace WPEAndroid
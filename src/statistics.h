@@ -0,0 +1,94 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Building blocks for the counters behind WPEAndroidViewBackend_getStatistics(). They are
+// updated on the UI thread but kept as relaxed atomics, so that reading them never races.
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <wpe-android/view-backend.h>
+
+namespace WPEAndroid {
+
+using Counter = std::atomic<uint64_t>;
+
+inline void increment(Counter& counter, uint64_t value = 1)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline void decrement(Counter& counter, uint64_t value = 1)
+{
+    counter.fetch_sub(value, std::memory_order_relaxed);
+}
+
+inline uint64_t load(const Counter& counter)
+{
+    return counter.load(std::memory_order_relaxed);
+}
+
+class LatencyHistogram {
+public:
+    static const size_t bucketCount = WPE_ANDROID_LATENCY_HISTOGRAM_BUCKETS;
+
+    LatencyHistogram()
+    {
+        for (auto& bucket : m_buckets)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+
+    void add(int64_t microseconds)
+    {
+        uint64_t value = microseconds > 0 ? uint64_t(microseconds) : 0;
+
+        // Bucket i holds [2^i, 2^(i+1)) microseconds
+        size_t bucket = 0;
+        while (bucket + 1 < bucketCount && value >> (bucket + 1))
+            bucket++;
+
+        increment(m_buckets[bucket]);
+        increment(m_count);
+        increment(m_totalMicroseconds, value);
+    }
+
+    void copyTo(WPEAndroidLatencyHistogram& histogram) const
+    {
+        histogram.count = load(m_count);
+        histogram.totalMicroseconds = load(m_totalMicroseconds);
+        for (size_t i = 0; i < bucketCount; ++i)
+            histogram.buckets[i] = load(m_buckets[i]);
+    }
+
+    void addTo(WPEAndroidLatencyHistogram& histogram) const
+    {
+        histogram.count += load(m_count);
+        histogram.totalMicroseconds += load(m_totalMicroseconds);
+        for (size_t i = 0; i < bucketCount; ++i)
+            histogram.buckets[i] += load(m_buckets[i]);
+    }
+
+private:
+    std::array<Counter, bucketCount> m_buckets;
+    Counter m_count { 0 };
+    Counter m_totalMicroseconds { 0 };
+};
+
+} // namespace WPEAndroid
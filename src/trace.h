@@ -0,0 +1,110 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Trace points for the frame and IPC paths. They show up in Perfetto and systrace through atrace
+// on Android, and on desktop Linux in the Chrome JSON file named by WPE_ANDROID_TRACE_FILE.
+// While no trace is being recorded a trace point costs one relaxed atomic load, the state being
+// refreshed once per frame. Building with WPE_ANDROID_TRACING=0 removes them altogether.
+
+#include <atomic>
+#include <cstdint>
+
+#include "platform.h"
+
+#ifndef WPE_ANDROID_TRACING
+#define WPE_ANDROID_TRACING 1
+#endif
+
+namespace WPEAndroid {
+
+namespace Trace {
+
+extern std::atomic<bool> s_enabled;
+
+inline bool isEnabled()
+{
+#if WPE_ANDROID_TRACING
+    return s_enabled.load(std::memory_order_relaxed);
+#else
+    return false;
+#endif
+}
+
+// Picks up recordings started or stopped since the last call
+inline void refresh()
+{
+#if WPE_ANDROID_TRACING
+    s_enabled.store(Platform::traceEnabled(), std::memory_order_relaxed);
+#endif
+}
+
+class Scope {
+public:
+    explicit Scope(const char* name)
+        : m_active(isEnabled())
+    {
+        if (m_active)
+            Platform::traceBegin(name);
+    }
+
+    ~Scope()
+    {
+        if (m_active)
+            Platform::traceEnd();
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    bool m_active;
+};
+
+inline void counter(const char* name, int64_t value)
+{
+    if (isEnabled())
+        Platform::traceCounter(name, value);
+}
+
+// Pool IDs are unique in the UI process, so together with the frame ID of a commit they
+// identify a frame in the traces of every process
+inline uint64_t frameFlowID(uint32_t poolID, uint32_t frameID)
+{
+    return uint64_t(poolID) << 32 | frameID;
+}
+
+inline void flow(const char* name, uint64_t id, Platform::TraceFlow phase)
+{
+    if (isEnabled())
+        Platform::traceFlow(name, id, phase);
+}
+
+} // namespace Trace
+
+} // namespace WPEAndroid
+
+#if WPE_ANDROID_TRACING
+#define WPE_TRACE_CONCAT_IMPL(a, b) a##b
+#define WPE_TRACE_CONCAT(a, b) WPE_TRACE_CONCAT_IMPL(a, b)
+// Named after the line, so that nested scopes of the same function do not shadow each other
+#define WPE_TRACE_SCOPE(name) WPEAndroid::Trace::Scope WPE_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define WPE_TRACE_SCOPE(name) ((void)0)
+#endif
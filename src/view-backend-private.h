@@ -19,11 +19,13 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 #include <wpe-android/view-backend.h>
 
 #include "ipc.h"
+#include "statistics.h"
 
 struct AHardwareBuffer;
 
@@ -36,6 +38,7 @@ class AndroidViewBackend {
 public:
 
     AndroidViewBackend(uint32_t initialWidth, uint32_t initialHeight);
+    ~AndroidViewBackend();
 
     uint32_t initialWidth() const { return m_initialWidth; }
     uint32_t initialHeight() const { return m_initialHeight; }
@@ -47,6 +50,11 @@ public:
 
     void commitBuffer(Buffer* buffer, int fenceID);
 
+    void requestSnapshot(float scale, void* context, WPEAndroidViewBackend_Snapshot func);
+
+    // Monotonic time of the last commit not yet followed by a frame complete, 0 if none
+    int64_t takeUncompletedCommitTime();
+
 private:
 
     ViewBackend *m_impl = nullptr;
@@ -56,16 +64,47 @@ private:
 
     using CommitBufferCallback = std::function<void(Buffer* buffer, int fenceID)>;
     CommitBufferCallback m_commitBufferCallback;
+
+    // Buffers can be deleted behind our back, so the last commit is looked up again when needed
+    struct {
+        bool valid { false };
+        uint32_t poolID { 0 };
+        uint32_t bufferID { 0 };
+        int fenceFD { -1 };
+        int64_t time { 0 };
+        bool completed { false };
+    } m_lastCommit;
+};
+
+// What a view wants its buffers allocated as, see IPC::PoolFormat
+struct BufferFormat {
+    uint32_t format { 0 };
+    uint64_t usage { 0 };
+    bool opaque { false };
 };
 
-class ViewBackend : public IPC::Host::Handler {
+struct ViewStatistics {
+    Counter framesCommitted { 0 };
+    Counter framesReleased { 0 };
+    Counter frameCompletesSent { 0 };
+    Counter inputEventsDispatched { 0 };
+    Counter inputEventsCoalesced { 0 };
+    LatencyHistogram commitToRelease;
+    LatencyHistogram commitToFrameComplete;
+};
+
+class ViewBackend {
 public:
     ViewBackend(AndroidViewBackend* androidViewBackend, WPEViewBackend* wpeViewBackend);
     virtual ~ViewBackend();
 
     void initialize();
 
-    IPC::Host& ipcHost() { return m_ipcHost; }
+    uint32_t viewId() const { return m_viewId; }
+
+    // The socket libwpe hands to the renderer target only tells it the view ID, pools are
+    // constructed and driven over the connection of its WebProcess
+    int createRendererHostFD();
 
     AndroidViewBackend* androidBackend() const { return m_androidViewBackend; }
 
@@ -73,23 +112,88 @@ public:
 
     void setWPEBackend(WPEViewBackend* backend);
 
-    void frameComplete();
+    // Times in CLOCK_MONOTONIC microseconds, 0 when unknown
+    void frameComplete(int64_t presentationTime = 0, int64_t nextDeadline = 0);
     void releaseBuffer(Buffer*);
 
-private:
-
     void registerPool(uint32_t poolId);
     void unregisterPool(uint32_t poolId);
 
-    // IPC::Host::Handler
-    void handleMessage(char*, size_t) override;
+    void bufferCommitted(uint32_t poolId, uint32_t frameId);
+
+    const BufferFormat& bufferFormat() const { return m_bufferFormat; }
+    void setBufferFormat(const BufferFormat&);
+
+    bool visible() const { return m_visible; }
+    void setVisible(bool);
+
+    // Sizes set within a frame interval of the last one dispatched are dispatched together at
+    // its end, the last one winning
+    void setSize(uint32_t width, uint32_t height);
+
+    // Input events, dispatched in order. Motion is held until the next frame completion, or a
+    // frame interval at most, and only its latest sample per touch point, or for the pointer,
+    // is dispatched. Other events go right away, after the motion held before them.
+    void dispatchTouchEvents(const struct wpe_input_touch_event*, size_t count);
+    void dispatchPointerEvents(const struct wpe_input_pointer_event*, size_t count);
+    void dispatchKeyboardEvents(const struct wpe_input_keyboard_event*, size_t count);
+
+    ViewStatistics& statistics() { return m_statistics; }
+    void getStatistics(WPEAndroidViewBackendStatistics&);
+
+private:
 
     AndroidViewBackend* m_androidViewBackend;
     WPEViewBackend* m_wpeViewBackend;
 
-    IPC::Host m_ipcHost;
+    uint32_t m_viewId { 0 };
+    // Identifies this view in IPC captures
+    uint32_t m_captureEndpoint { 0 };
 
     std::vector<uint32_t> m_poolIds;
+    BufferFormat m_bufferFormat;
+    bool m_visible { true };
+
+    // Microseconds, as told by the consumer along with frame completion
+    int64_t m_frameInterval { 16667 };
+
+    void dispatchSize();
+
+    struct {
+        // Last set, and last dispatched to WebKit
+        uint32_t width { 0 };
+        uint32_t height { 0 };
+        uint32_t dispatchedWidth { 0 };
+        uint32_t dispatchedHeight { 0 };
+        bool dispatched { false };
+        int64_t dispatchTime { 0 };
+        std::unique_ptr<IPC::Timer> timer;
+    } m_size;
+
+    void scheduleInputFlush();
+    void flushInput();
+
+    // Only the latest motion of each kind is held: a touch motion carries every touch point, and
+    // pointer buttons only change with button events, which are never held
+    struct {
+        bool touchHeld { false };
+        struct wpe_input_touch_event touchEvent;
+        // Pointed to by touchEvent once dispatched
+        std::vector<struct wpe_input_touch_event_raw> touchPoints;
+
+        bool pointerHeld { false };
+        struct wpe_input_pointer_event pointerEvent;
+
+        std::unique_ptr<IPC::Timer> timer;
+    } m_input;
+
+    struct {
+        bool valid { false };
+        uint32_t poolID { 0 };
+        uint32_t frameID { 0 };
+    } m_lastCommittedFrame;
+
+    ViewStatistics m_statistics;
 };
 
 } // namespace WPEAndroid
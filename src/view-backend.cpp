@@ -19,13 +19,17 @@
 #include "view-backend-private.h"
 
 #include <algorithm>
-#include <android/hardware_buffer.h>
 #include <cstdint>
 #include <errno.h>
+#include <iterator>
+#include <unistd.h>
 
+#include "ipc-capture.h"
 #include "ipc-messages.h"
 #include "logging.h"
 #include "renderer-host-private.h"
+#include "snapshot.h"
+#include "trace.h"
 
 namespace WPEAndroid {
 
@@ -43,6 +47,13 @@ Buffer* toAndroidBuffer(WPEAndroidBuffer* buffer)
 AndroidViewBackend::AndroidViewBackend(uint32_t initialWidth, uint32_t initialHeight)
     : m_initialWidth(initialWidth), m_initialHeight(initialHeight) { }
 
+AndroidViewBackend::~AndroidViewBackend()
+{
+    RendererHost::instance().dropBatchedCommit(this);
+    if (m_lastCommit.fenceFD != -1)
+        close(m_lastCommit.fenceFD);
+}
+
 void AndroidViewBackend::setCommitBufferCallback(void* context, WPEAndroidViewBackend_CommitBuffer func)
 {
     m_commitBufferCallback = [context, func](Buffer *buffer, int fenceID){
@@ -53,33 +64,113 @@ void AndroidViewBackend::setCommitBufferCallback(void* context, WPEAndroidViewBa
 
 void AndroidViewBackend::commitBuffer(Buffer* buffer, int fenceID)
 {
-    m_commitBufferCallback(buffer, fenceID);
+    // The fence is owned by the consumer, keep our own copy for snapshots
+    if (m_lastCommit.fenceFD != -1)
+        close(m_lastCommit.fenceFD);
+    m_lastCommit.fenceFD = fenceID >= 0 ? dup(fenceID) : -1;
+    m_lastCommit.poolID = buffer->poolID();
+    m_lastCommit.bufferID = buffer->bufferID();
+    m_lastCommit.valid = true;
+    m_lastCommit.time = buffer->commitTime();
+    m_lastCommit.completed = false;
+
+    auto& rendererHost = RendererHost::instance();
+    if (rendererHost.batchesCommits())
+        rendererHost.batchCommit(this, buffer, fenceID);
+    else
+        m_commitBufferCallback(buffer, fenceID);
+}
+
+void AndroidViewBackend::requestSnapshot(float scale, void* context, WPEAndroidViewBackend_Snapshot func)
+{
+    Buffer* buffer = nullptr;
+    if (m_lastCommit.valid) {
+        auto* bufferPool = RendererHost::instance().findBufferPool(m_lastCommit.poolID);
+        if (bufferPool && m_lastCommit.bufferID < bufferPool->size())
+            buffer = bufferPool->getBuffer(m_lastCommit.bufferID);
+    }
+
+    // Once released, the renderer may already be drawing the next frame into the buffer
+    if (!buffer || !buffer->locked()) {
+        ALOGV("AndroidViewBackend::requestSnapshot(): no committed buffer available");
+        func(context, nullptr, 0, 0, 0);
+        return;
+    }
+
+    buffer->acquireSnapshotHold();
+    int fenceFD = m_lastCommit.fenceFD != -1 ? dup(m_lastCommit.fenceFD) : -1;
+    Snapshot::request(*buffer, fenceFD, scale, [buffer, context, func](const void* pixels, uint32_t width, uint32_t height, uint32_t stride) {
+        func(context, pixels, width, height, stride);
+        RendererHost::instance().snapshotFinished(buffer);
+    });
+}
+
+int64_t AndroidViewBackend::takeUncompletedCommitTime()
+{
+    if (!m_lastCommit.valid || m_lastCommit.completed)
+        return 0;
+
+    m_lastCommit.completed = true;
+    return m_lastCommit.time;
 }
 
 ViewBackend::ViewBackend(AndroidViewBackend *androidViewBackend, WPEViewBackend* wpeViewBackend)
-    : m_androidViewBackend(androidViewBackend), m_wpeViewBackend(wpeViewBackend) { }
+    : m_androidViewBackend(androidViewBackend), m_wpeViewBackend(wpeViewBackend)
+{
+    m_viewId = RendererHost::instance().registerView(this);
+    m_captureEndpoint = IPC::Capture::openEndpoint();
+}
 
 ViewBackend::~ViewBackend()
 {
     while (!m_poolIds.empty())
         unregisterPool(m_poolIds.front());
 
-    m_ipcHost.deinitialize();
+    RendererHost::instance().unregisterView(m_viewId);
+    IPC::Capture::closeEndpoint(m_captureEndpoint);
     m_androidViewBackend = nullptr;
     m_wpeViewBackend = nullptr;
 }
 
 void ViewBackend::initialize()
 {
-    m_ipcHost.initialize(*this);
-    wpe_view_backend_dispatch_set_size(wpeBackend(),
-        m_androidViewBackend->initialWidth(), m_androidViewBackend->initialHeight());
+    // Sizes set before are not dispatched yet
+    if (!m_size.width || !m_size.height) {
+        m_size.width = m_androidViewBackend->initialWidth();
+        m_size.height = m_androidViewBackend->initialHeight();
+    }
+    if (m_size.timer)
+        m_size.timer->stop();
+    dispatchSize();
+}
+
+int ViewBackend::createRendererHostFD()
+{
+    IPC::ViewIdentity identity = { };
+    identity.viewID = m_viewId;
+
+    IPC::Message message;
+    IPC::ViewIdentity::construct(message, identity);
+    if (IPC::Capture::isActive())
+        IPC::Capture::record(IPC::Capture::RecordType::Sent, m_captureEndpoint, IPC::Message::data(message), IPC::Message::size);
+    return IPC::createMessageSocket(IPC::Message::data(message), IPC::Message::size);
 }
 
-void ViewBackend::frameComplete()
+void ViewBackend::frameComplete(int64_t presentationTime, int64_t nextDeadline)
 {
-    // Assume that last released buffer is from the completed frame
-    RendererHost::instance().frameComplete();
+    // Anything outside of 30 to 240Hz is not a refresh rate
+    if (presentationTime && nextDeadline - presentationTime >= 4000 && nextDeadline - presentationTime <= 34000)
+        m_frameInterval = nextDeadline - presentationTime;
+
+    // WebKit gets the motion of this frame before starting the next one
+    flushInput();
+
+    if (m_lastCommittedFrame.valid)
+        RendererHost::instance().frameComplete(m_lastCommittedFrame.poolID, m_lastCommittedFrame.frameID, presentationTime, nextDeadline);
+
+    increment(m_statistics.frameCompletesSent);
+    if (int64_t commitTime = m_androidViewBackend->takeUncompletedCommitTime())
+        m_statistics.commitToFrameComplete.add(g_get_monotonic_time() - commitTime);
 
     wpe_view_backend_dispatch_frame_displayed(wpeBackend());
 }
@@ -89,6 +180,195 @@ void ViewBackend::releaseBuffer(Buffer* buffer)
     RendererHost::instance().releaseBuffer(buffer);
 }
 
+void ViewBackend::getStatistics(WPEAndroidViewBackendStatistics& statistics)
+{
+    statistics = { };
+    statistics.framesCommitted = load(m_statistics.framesCommitted);
+    statistics.framesReleased = load(m_statistics.framesReleased);
+    statistics.frameCompletesSent = load(m_statistics.frameCompletesSent);
+    statistics.inputEventsDispatched = load(m_statistics.inputEventsDispatched);
+    statistics.inputEventsCoalesced = load(m_statistics.inputEventsCoalesced);
+    m_statistics.commitToRelease.copyTo(statistics.commitToRelease);
+    m_statistics.commitToFrameComplete.copyTo(statistics.commitToFrameComplete);
+
+    for (uint32_t poolId : m_poolIds) {
+        auto* bufferPool = RendererHost::instance().findBufferPool(poolId);
+        if (!bufferPool)
+            continue;
+
+        auto& poolStatistics = bufferPool->statistics();
+        statistics.bufferAllocations += load(poolStatistics.bufferAllocations);
+        statistics.liveBufferBytes += load(poolStatistics.liveBufferBytes);
+        statistics.pendingDeleteBuffers += load(poolStatistics.pendingDeleteBuffers);
+        statistics.starvationEvents += load(poolStatistics.starvationEvents);
+        statistics.starvationMilliseconds += load(poolStatistics.starvationMilliseconds);
+    }
+
+    RendererHost::instance().addQueueingDelays(m_poolIds, statistics);
+}
+
+void ViewBackend::bufferCommitted(uint32_t poolId, uint32_t frameId)
+{
+    m_lastCommittedFrame.valid = true;
+    m_lastCommittedFrame.poolID = poolId;
+    m_lastCommittedFrame.frameID = frameId;
+}
+
+void ViewBackend::setBufferFormat(const BufferFormat& bufferFormat)
+{
+    if (bufferFormat.format == m_bufferFormat.format && bufferFormat.usage == m_bufferFormat.usage
+        && bufferFormat.opaque == m_bufferFormat.opaque)
+        return;
+
+    // Pools constructed later get it in their PoolConstructionReply
+    m_bufferFormat = bufferFormat;
+    for (uint32_t poolId : m_poolIds)
+        RendererHost::instance().setPoolFormat(poolId, m_bufferFormat);
+}
+
+void ViewBackend::setVisible(bool visible)
+{
+    if (visible == m_visible)
+        return;
+    ALOGV("ViewBackend::setVisible() %d", visible);
+    m_visible = visible;
+
+    // WebKit stops painting hidden views, their pools then give up the buffers they can
+    if (visible)
+        wpe_view_backend_add_activity_state(wpeBackend(), wpe_view_activity_state_visible);
+    else
+        wpe_view_backend_remove_activity_state(wpeBackend(), wpe_view_activity_state_visible);
+
+    // Pools constructed later get it in their PoolConstructionReply
+    for (uint32_t poolId : m_poolIds)
+        RendererHost::instance().setPoolVisible(poolId, m_visible);
+}
+
+void ViewBackend::setSize(uint32_t width, uint32_t height)
+{
+    if (!width || !height)
+        return;
+
+    m_size.width = width;
+    m_size.height = height;
+    if (!m_size.dispatched || (m_size.timer && m_size.timer->isActive()))
+        return;
+
+    // The first size of a storm goes right away, the others wait for the end of the interval
+    int64_t elapsed = g_get_monotonic_time() - m_size.dispatchTime;
+    if (elapsed >= m_frameInterval) {
+        dispatchSize();
+        return;
+    }
+
+    if (!m_size.timer)
+        m_size.timer.reset(new IPC::Timer("WPEBackend-android::resize", [this] { dispatchSize(); }));
+    m_size.timer->start(m_frameInterval - elapsed);
+}
+
+void ViewBackend::dispatchSize()
+{
+    // Each size the renderer gets costs it its whole pool, a storm ending where it started costs nothing
+    if (m_size.dispatched && m_size.width == m_size.dispatchedWidth && m_size.height == m_size.dispatchedHeight)
+        return;
+
+    ALOGV("ViewBackend::dispatchSize() (%u,%u)", m_size.width, m_size.height);
+    m_size.dispatched = true;
+    m_size.dispatchedWidth = m_size.width;
+    m_size.dispatchedHeight = m_size.height;
+    m_size.dispatchTime = g_get_monotonic_time();
+    wpe_view_backend_dispatch_set_size(wpeBackend(), m_size.width, m_size.height);
+}
+
+void ViewBackend::dispatchTouchEvents(const struct wpe_input_touch_event* events, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        auto& event = events[i];
+        if (event.type != wpe_input_touch_event_type_motion) {
+            flushInput();
+            auto dispatched = event;
+            wpe_view_backend_dispatch_touch_event(wpeBackend(), &dispatched);
+            increment(m_statistics.inputEventsDispatched);
+            continue;
+        }
+
+        if (m_input.touchHeld)
+            increment(m_statistics.inputEventsCoalesced);
+        m_input.touchHeld = true;
+        m_input.touchEvent = event;
+        m_input.touchPoints.assign(event.touchpoints, event.touchpoints + event.touchpoints_length);
+    }
+    scheduleInputFlush();
+}
+
+void ViewBackend::dispatchPointerEvents(const struct wpe_input_pointer_event* events, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        auto& event = events[i];
+        if (event.type != wpe_input_pointer_event_type_motion) {
+            flushInput();
+            auto dispatched = event;
+            wpe_view_backend_dispatch_pointer_event(wpeBackend(), &dispatched);
+            increment(m_statistics.inputEventsDispatched);
+            continue;
+        }
+
+        if (m_input.pointerHeld)
+            increment(m_statistics.inputEventsCoalesced);
+        m_input.pointerHeld = true;
+        m_input.pointerEvent = event;
+    }
+    scheduleInputFlush();
+}
+
+void ViewBackend::dispatchKeyboardEvents(const struct wpe_input_keyboard_event* events, size_t count)
+{
+    if (count)
+        flushInput();
+
+    for (size_t i = 0; i < count; ++i) {
+        auto dispatched = events[i];
+        wpe_view_backend_dispatch_keyboard_event(wpeBackend(), &dispatched);
+        increment(m_statistics.inputEventsDispatched);
+    }
+}
+
+void ViewBackend::scheduleInputFlush()
+{
+    // Views that are not rendering get no frame completion
+    if ((!m_input.touchHeld && !m_input.pointerHeld) || (m_input.timer && m_input.timer->isActive()))
+        return;
+
+    if (!m_input.timer)
+        m_input.timer.reset(new IPC::Timer("WPEBackend-android::input", [this] { flushInput(); }));
+    m_input.timer->start(m_frameInterval);
+}
+
+void ViewBackend::flushInput()
+{
+    if (m_input.timer)
+        m_input.timer->stop();
+    if (!m_input.touchHeld && !m_input.pointerHeld)
+        return;
+    WPE_TRACE_SCOPE("ViewBackend::flushInput");
+
+    // Dispatching may well lead to more input
+    if (m_input.touchHeld) {
+        m_input.touchHeld = false;
+        auto touchEvent = m_input.touchEvent;
+        auto touchPoints = std::move(m_input.touchPoints);
+        touchEvent.touchpoints = touchPoints.data();
+        wpe_view_backend_dispatch_touch_event(wpeBackend(), &touchEvent);
+        increment(m_statistics.inputEventsDispatched);
+    }
+    if (m_input.pointerHeld) {
+        m_input.pointerHeld = false;
+        auto pointerEvent = m_input.pointerEvent;
+        wpe_view_backend_dispatch_pointer_event(wpeBackend(), &pointerEvent);
+        increment(m_statistics.inputEventsDispatched);
+    }
+}
+
 void ViewBackend::registerPool(uint32_t poolId)
 {
     m_poolIds.push_back(poolId);
@@ -104,32 +384,9 @@ void ViewBackend::unregisterPool(uint32_t poolId)
 
     m_poolIds.erase(it);
     RendererHost::instance().unregisterViewBackend(poolId);
-}
 
-void ViewBackend::handleMessage(char* data, size_t size)
-{
-    ALOGV("ViewBackend::handleMessage() %p[%zu]", data, size);
-    if (size != IPC::Message::size)
-        return;
-
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::RegisterPool::code:
-    {
-        auto registerPoolMsg = IPC::RegisterPool::from(message);
-        registerPool(registerPoolMsg.poolID);
-        break;
-    }
-    case IPC::UnregisterPool::code:
-    {
-        auto unregisterPoolMsg = IPC::UnregisterPool::from(message);
-        unregisterPool(unregisterPoolMsg.poolID);
-        break;
-    }
-    default:
-        ALOGE("ViewBackend: invalid message");
-        break;
-    }
+    if (m_lastCommittedFrame.poolID == poolId)
+        m_lastCommittedFrame.valid = false;
 }
 
 } // namespace WPEAndroid
@@ -164,7 +421,7 @@ struct wpe_view_backend_interface android_view_backend_impl = {
     [] (void* data) -> int
     {
         auto& impl = *static_cast<WPEAndroid::ViewBackend*>(data);
-        return impl.ipcHost().releaseClientFD();
+        return impl.createRendererHostFD();
     },
 };
 
@@ -206,6 +463,66 @@ void WPEAndroidViewBackend_dispatchFrameComplete(WPEAndroidViewBackend* backend)
     androidViewBackend->impl()->frameComplete();
 }
 
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_dispatchFrameCompleteWithTiming(WPEAndroidViewBackend* backend, int64_t presentationTime, int64_t nextDeadline)
+{
+    // The deadline is sent relative to the presentation, which is about now when not known
+    presentationTime /= 1000;
+    nextDeadline /= 1000;
+    if (nextDeadline && !presentationTime)
+        presentationTime = g_get_monotonic_time();
+
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->frameComplete(presentationTime, nextDeadline);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_setBufferFormat(WPEAndroidViewBackend* backend, uint32_t format, uint64_t usage, bool opaque)
+{
+    WPEAndroid::BufferFormat bufferFormat;
+    bufferFormat.format = format;
+    bufferFormat.usage = usage;
+    bufferFormat.opaque = opaque;
+
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->setBufferFormat(bufferFormat);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_setSize(WPEAndroidViewBackend* backend, uint32_t width, uint32_t height)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->setSize(width, height);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_dispatchTouchEvents(WPEAndroidViewBackend* backend, const struct wpe_input_touch_event* events, size_t count)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->dispatchTouchEvents(events, count);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_dispatchPointerEvents(WPEAndroidViewBackend* backend, const struct wpe_input_pointer_event* events, size_t count)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->dispatchPointerEvents(events, count);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_dispatchKeyboardEvents(WPEAndroidViewBackend* backend, const struct wpe_input_keyboard_event* events, size_t count)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->dispatchKeyboardEvents(events, count);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_setVisible(WPEAndroidViewBackend* backend, bool visible)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->setVisible(visible);
+}
+
 __attribute__((visibility("default")))
 void WPEAndroidViewBackend_setCommitBufferHandler(WPEAndroidViewBackend* backend, void* context, WPEAndroidViewBackend_CommitBuffer func)
 {
@@ -213,6 +530,76 @@ void WPEAndroidViewBackend_setCommitBufferHandler(WPEAndroidViewBackend* backend
     androidViewBackend->setCommitBufferCallback(context, func);
 }
 
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_requestSnapshot(WPEAndroidViewBackend* backend, float scale, void* context, WPEAndroidViewBackend_Snapshot func)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->requestSnapshot(scale, context, func);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidViewBackend_getStatistics(WPEAndroidViewBackend* backend, WPEAndroidViewBackendStatistics* statistics)
+{
+    auto* androidViewBackend = WPEAndroid::toAndroidViewBackend(backend);
+    androidViewBackend->impl()->getStatistics(*statistics);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroid_setCommitBatchHandler(void* context, WPEAndroid_CommitBatch func)
+{
+    WPEAndroid::RendererHost::instance().setCommitBatchHandler(context, func);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroid_latchCommits()
+{
+    WPEAndroid::RendererHost::instance().latchCommits();
+}
+
+__attribute__((visibility("default")))
+void WPEAndroid_dumpIPCFlightRecorders(const char* reason)
+{
+    IPC::FlightRecorder::dumpAll(reason ? reason : "requested");
+}
+
+__attribute__((visibility("default")))
+bool WPEAndroid_setEventLoop(WPEAndroidEventLoop loop)
+{
+    switch (loop) {
+    case WPE_ANDROID_EVENT_LOOP_GLIB:
+        return IPC::EventSource::setThreadLoop(IPC::EventSource::Loop::GLib);
+    case WPE_ANDROID_EVENT_LOOP_LOOPER:
+        return IPC::EventSource::setThreadLoop(IPC::EventSource::Loop::Looper);
+    case WPE_ANDROID_EVENT_LOOP_EPOLL:
+        return IPC::EventSource::setThreadLoop(IPC::EventSource::Loop::Epoll);
+    }
+    return false;
+}
+
+__attribute__((visibility("default")))
+int WPEAndroid_getEventLoopFd()
+{
+    return IPC::EventSource::epollFd();
+}
+
+__attribute__((visibility("default")))
+void WPEAndroid_dispatchEvents()
+{
+    IPC::EventSource::dispatchEpollEvents();
+}
+
+__attribute__((visibility("default")))
+bool WPEAndroid_startIPCCapture(const char* path)
+{
+    return path && IPC::Capture::start(path);
+}
+
+__attribute__((visibility("default")))
+void WPEAndroid_stopIPCCapture()
+{
+    IPC::Capture::stop();
+}
+
 __attribute__((visibility("default")))
 AHardwareBuffer* WPEAndroidBuffer_getAHardwareBuffer(WPEAndroidBuffer* buffer)
 {
@@ -220,4 +607,67 @@ AHardwareBuffer* WPEAndroidBuffer_getAHardwareBuffer(WPEAndroidBuffer* buffer)
     return androidBuffer->hardwareBuffer();
 }
 
+__attribute__((visibility("default")))
+void* WPEAndroidBuffer_getData(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->data();
+}
+
+__attribute__((visibility("default")))
+uint32_t WPEAndroidBuffer_getStride(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->stride();
+}
+
+__attribute__((visibility("default")))
+uint32_t WPEAndroidBuffer_getWidth(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->width();
+}
+
+__attribute__((visibility("default")))
+uint32_t WPEAndroidBuffer_getHeight(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->height();
+}
+
+__attribute__((visibility("default")))
+uint64_t WPEAndroidBuffer_getID(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->uniqueID();
+}
+
+__attribute__((visibility("default")))
+void WPEAndroidBuffer_setUserData(WPEAndroidBuffer* buffer, const void* key, void* data, WPEAndroidBuffer_DestroyNotify destroyNotify)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    androidBuffer->setUserData(key, data, destroyNotify);
+}
+
+__attribute__((visibility("default")))
+void* WPEAndroidBuffer_getUserData(WPEAndroidBuffer* buffer, const void* key)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->userData(key);
+}
+
+__attribute__((visibility("default")))
+uint32_t WPEAndroidBuffer_getFormat(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->format();
+}
+
+__attribute__((visibility("default")))
+bool WPEAndroidBuffer_isOpaque(WPEAndroidBuffer* buffer)
+{
+    auto* androidBuffer = WPEAndroid::toAndroidBuffer(buffer);
+    return androidBuffer->opaque();
+}
+
 } // extern "C"
@@ -0,0 +1,161 @@
+/**
+ * Copyright (C) 2024 Igalia S.L. <info@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Sends a memfd-backed buffer from an IPC::Client to an IPC::Host over their socketpair, the way
+// renderers without hardware buffers hand their frames to the UI process, and checks both sides
+// map the same memory.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <gio/gio.h>
+#include <unistd.h>
+
+#include "ipc.h"
+#include "ipc-messages.h"
+#include "shared-memory.h"
+
+namespace {
+
+int s_failures = 0;
+
+void check(bool condition, const char* what)
+{
+    if (!condition) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        s_failures++;
+    }
+}
+
+const uint32_t s_width = 16;
+const uint32_t s_height = 8;
+const uint32_t s_stride = s_width * 4;
+
+void fill(WPEAndroid::SharedMemory& memory, uint8_t seed)
+{
+    auto* bytes = static_cast<uint8_t*>(memory.data());
+    for (size_t i = 0; i < memory.size(); ++i)
+        bytes[i] = uint8_t(seed + i);
+}
+
+bool filledWith(const WPEAndroid::SharedMemory& memory, uint8_t seed)
+{
+    auto* bytes = static_cast<const uint8_t*>(memory.data());
+    for (size_t i = 0; i < memory.size(); ++i) {
+        if (bytes[i] != uint8_t(seed + i))
+            return false;
+    }
+    return true;
+}
+
+class HostHandler final : public IPC::Host::Handler {
+public:
+    IPC::Host host;
+    IPC::SharedMemoryBufferAllocation allocation { };
+    WPEAndroid::SharedMemory memory;
+    int receivedFd { -1 };
+    bool received { false };
+
+    // IPC::Host::Handler
+    void handleMessage(char* data, size_t) override
+    {
+        auto& message = IPC::Message::cast(data);
+        if (message.messageCode != IPC::SharedMemoryBufferAllocation::code)
+            return;
+
+        allocation = IPC::SharedMemoryBufferAllocation::from(message);
+        int fd = -EAGAIN;
+        while (fd == -EAGAIN)
+            fd = host.receiveFileDescriptor();
+        receivedFd = fd;
+        if (fd >= 0)
+            memory.map(fd, size_t(allocation.stride) * allocation.height);
+        received = true;
+    }
+};
+
+class ClientHandler final : public IPC::Client::Handler {
+public:
+    // IPC::Client::Handler
+    void handleMessage(char*, size_t) override { }
+};
+
+} // namespace
+
+int main()
+{
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    HostHandler hostHandler;
+    hostHandler.host.initialize(hostHandler);
+
+    ClientHandler clientHandler;
+    IPC::Client client;
+    client.initialize(clientHandler, hostHandler.host.releaseClientFD(true));
+
+    WPEAndroid::SharedMemory memory;
+    check(memory.allocate(size_t(s_stride) * s_height), "allocate() succeeds");
+    check(memory.fd() >= 0 && memory.data() && memory.size() == size_t(s_stride) * s_height, "the region is mapped");
+    if (memory.data())
+        fill(memory, 1);
+
+    IPC::SharedMemoryBufferAllocation allocation;
+    allocation.poolID = 1;
+    allocation.bufferID = 2;
+    allocation.width = s_width;
+    allocation.height = s_height;
+    allocation.stride = s_stride;
+    allocation.format = 1;
+
+    IPC::Message message;
+    IPC::SharedMemoryBufferAllocation::construct(message, allocation);
+    client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    check(client.sendFileDescriptor(memory.fd()) >= 0, "sendFileDescriptor() succeeds");
+
+    gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (!hostHandler.received && g_get_monotonic_time() < deadline) {
+        if (!g_main_context_iteration(context, FALSE))
+            usleep(1000);
+    }
+
+    check(hostHandler.received, "the host receives the allocation");
+    check(hostHandler.allocation.poolID == 1 && hostHandler.allocation.bufferID == 2
+        && hostHandler.allocation.stride == s_stride && hostHandler.allocation.height == s_height,
+        "the allocation arrives as sent");
+    check(hostHandler.receivedFd >= 0 && hostHandler.receivedFd != memory.fd(), "the host gets a descriptor of its own");
+    check(hostHandler.memory.data() && hostHandler.memory.size() == memory.size(), "the host maps the region");
+    if (hostHandler.memory.data() && memory.data()) {
+        check(filledWith(hostHandler.memory, 1), "the host reads what was written before sending");
+        fill(memory, 7);
+        check(filledWith(hostHandler.memory, 7), "the host reads what is written after sending");
+    }
+
+    WPEAndroid::SharedMemory shorter;
+    check(!shorter.map(dup(memory.fd()), memory.size() * 2), "a region shorter than announced is not mapped");
+
+    client.deinitialize();
+    hostHandler.host.deinitialize();
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+
+    if (s_failures)
+        std::fprintf(stderr, "test-shared-memory: %d failures\n", s_failures);
+    return s_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}